@@ -0,0 +1,47 @@
+#ifndef CAR_TASK_H
+#define CAR_TASK_H
+
+#include <coroutine>
+#include <exception>
+#include <utility>
+
+// Owner of a car's behaviour coroutine. The coroutine runs as soon as it is
+// called, up to its first co_await, and from then on is resumed by whatever it
+// is waiting on. Its frame is the car's only per-car stack: it holds the locals
+// of the loop and is freed with the task.
+class CarTask {
+public:
+    struct promise_type {
+        CarTask get_return_object() {
+            return CarTask(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; } // Kept until the task is destroyed
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+
+    CarTask() = default;
+    CarTask(CarTask&& other) noexcept : handle(std::exchange(other.handle, {})) {}
+    CarTask& operator=(CarTask&& other) noexcept {
+        if (this != &other) {
+            reset();
+            handle = std::exchange(other.handle, {});
+        }
+        return *this;
+    }
+    ~CarTask() { reset(); }
+
+    bool done() const { return !handle || handle.done(); }
+
+private:
+    explicit CarTask(std::coroutine_handle<promise_type> h) : handle(h) {}
+    void reset() {
+        if (handle) handle.destroy();
+        handle = {};
+    }
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+#endif // CAR_TASK_H
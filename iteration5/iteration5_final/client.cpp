@@ -1,18 +1,20 @@
 #include "client.h"
+#include "text_parser.h"
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <cstring>
 #include <chrono>
-#include <thread>
 #include <arpa/inet.h>
+#include <poll.h>
 #include <unistd.h>
 
 #define SCHEDULER_PORT 5002 // Port number for the scheduler
 #define SCHEDULER_IP "127.0.0.1" // IP address of the scheduler
 
 // Client constructor: Initializes the socket and scheduler address
-Client::Client() {
+Client::Client(Clock& clock) : clock(clock) {
     // Create a UDP socket
     sockfd = socket(AF_INET, SOCK_DGRAM, 0);
     if (sockfd < 0) {
@@ -39,24 +41,161 @@ int Client::getSecondsFromTimestamp(const std::string& timestamp) {
 // Send a request to the scheduler with the given floor, direction, and target floor
 void Client::sendRequest(int floor, std::string direction, int targetFloor) {
     // Format the message to be sent
-    std::string message = std::to_string(floor) + " " + direction + " " + std::to_string(targetFloor);
-    // Send the message via UDP to the scheduler
-    sendto(sockfd, message.c_str(), message.size(), 0, (struct sockaddr*)&schedulerAddr, sizeof(schedulerAddr));
+    std::string message = binary ? encodeRequest(floor, direction, targetFloor)
+                                 : formatRequest(floor, direction, targetFloor);
+    // Send the message through the scheduler's ring, or via UDP
+    if (!schedulerRing || !schedulerRing->send(sockfd, schedulerAddr, message.data(), message.size())) {
+        sendto(sockfd, message.c_str(), message.size(), 0, (struct sockaddr*)&schedulerAddr, sizeof(schedulerAddr));
+    }
+    recent.push_back({binary ? sendSeq : 0, {0, floor, direction, targetFloor}, attempt + 1});
+    if (recent.size() > CLIENT_SENT_KEPT) recent.pop_front();
     // Print the sent request to the console
     std::cout << "[Client] Sent request: Floor " << floor << " -> Floor " << targetFloor << " (" << direction << ")" << std::endl;
 }
 
-// Process requests from an input file
+// Wire format of a request: "<floor> <direction> <target_floor>"
+std::string Client::formatRequest(int floor, const std::string& direction, int targetFloor) {
+    return std::to_string(floor) + " " + direction + " " + std::to_string(targetFloor);
+}
+
+// Binary request: header with the pickup floor (aux 1 for DOWN), then the
+// target floor as int16. The client hears back only if its request is
+// refused, so the scheduler takes either format from it.
+std::string Client::encodeRequest(int floor, const std::string& direction, int targetFloor) {
+    std::string message(wireSize(MsgType::REQUEST), '\0');
+    uint8_t down = direction == "DOWN" ? 1 : 0;
+    size_t at = putWire(&message[0], 0, wireHeader(MsgType::REQUEST, 0, ++sendSeq, clock.now(), floor, down));
+    putWire(&message[0], at, (int16_t)targetFloor);
+    return message;
+}
+
+void Client::setBinary(bool enabled) {
+    binary = enabled;
+}
+
+void Client::setSharedMemory(bool enabled) {
+    schedulerRing.reset();
+    if (enabled) ShmRing::refresh(schedulerRing, ntohs(schedulerAddr.sin_port));
+}
+
+// Set before setSharedMemory(), whose ring is named after the scheduler's port
+void Client::setScheduler(const struct sockaddr_in& addr) {
+    schedulerAddr = addr;
+}
+
+// A NAK names a binary request by its seq and repeats a text one. The request
+// is sent again no sooner than the scheduler asked, and later with each
+// refusal, so clients that were turned away together do not all come back at
+// once.
+bool Client::handleNak(const char* data, size_t len) {
+    Nak nak;
+    bool named = isWireMessage(data, len) ? decodeNak(data, len, nak)
+                                          : parseNak(std::string_view(data, len), nak) && nak.seq == 0;
+    if (!named) return false;
+    auto match = std::find_if(recent.begin(), recent.end(), [&nak](const SentRequest& sent) {
+        if (nak.seq != 0) return sent.seq == nak.seq;
+        return sent.seq == 0 && sent.req.floor == nak.floor && sent.req.targetFloor == nak.targetFloor &&
+               (sent.req.direction == "DOWN") == nak.down;
+    });
+    if (match == recent.end()) return false;
+    SentRequest sent = *match;
+    recent.erase(match);
+    const TimedRequest& req = sent.req;
+    if (sent.attempts >= CLIENT_MAX_ATTEMPTS) {
+        std::cerr << "[Client] Giving up on Floor " << req.floor << " -> Floor " << req.targetFloor << " after "
+                  << sent.attempts << " refusals" << std::endl;
+        return true;
+    }
+    Clock::duration wait = backoff(sent.attempts, nak.retryAfterMs);
+    std::cout << "[Client] Request Floor " << req.floor << " -> Floor " << req.targetFloor << " refused ("
+              << nakReasonName(nak.reason) << "), retrying in "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(wait).count() << " ms" << std::endl;
+    retries.emplace(clock.now() + wait, sent);
+    return true;
+}
+
+// Half the doubled delay, plus a random part of the other half
+Clock::duration Client::backoff(int attempts, uint32_t retryAfterMs) {
+    long ceiling = std::min<long>(CLIENT_BACKOFF_MAX_MS, (long)CLIENT_BACKOFF_BASE_MS << std::min(attempts - 1, 16));
+    long ms = ceiling / 2 + std::uniform_int_distribution<long>(0, ceiling / 2)(jitter);
+    return std::chrono::milliseconds(std::max<long>(ms, retryAfterMs));
+}
+
+void Client::receiveNaks(Clock::time_point until) {
+    char buffer[1024];
+    while (true) {
+        if (!retries.empty() && retries.begin()->first < until) until = retries.begin()->first;
+        auto left = std::chrono::ceil<std::chrono::milliseconds>(until - clock.now()).count();
+        if (left <= 0) return;
+        struct pollfd fd = {sockfd, POLLIN, 0};
+        if (poll(&fd, 1, (int)left) <= 0) {
+            clock.sleepUntil(until); // Only a virtual clock has not got there by now
+            return;
+        }
+        ssize_t n;
+        while ((n = recv(sockfd, buffer, sizeof(buffer) - 1, MSG_DONTWAIT)) >= 0) {
+            buffer[n] = '\0';
+            handleNak(buffer, (size_t)n);
+        }
+    }
+}
+
+size_t Client::sendDueRetries() {
+    Clock::time_point now = clock.now();
+    size_t sent = 0;
+    while (!retries.empty() && retries.begin()->first <= now) {
+        SentRequest retry = retries.begin()->second;
+        retries.erase(retries.begin());
+        attempt = retry.attempts;
+        sendRequest(retry.req.floor, retry.req.direction, retry.req.targetFloor);
+        attempt = 0;
+        sent++;
+    }
+    return sent;
+}
+
+size_t Client::pendingRetries() const {
+    return retries.size();
+}
+
+// Process requests from an input file, sending each at its timestamp and
+// NAKed ones again as they come due. After the last send the client listens
+// a little longer, in case that one is refused too.
 void Client::processRequestsFromFile(const std::string& filename) {
+    auto startTime = clock.now(); // Get the start time for timing the requests
+    std::vector<TimedRequest> requests = loadRequests(filename);
+    size_t next = 0;
+    Clock::time_point lastSend = startTime;
+    auto listenAfter = std::chrono::milliseconds(CLIENT_NAK_WAIT_MS);
+    while (true) {
+        Clock::time_point due = next < requests.size() ? startTime + std::chrono::seconds(requests[next].time)
+                                : !retries.empty()     ? retries.begin()->first
+                                                       : lastSend + listenAfter;
+        receiveNaks(due);
+        if (sendDueRetries() > 0) lastSend = clock.now();
+        if (clock.now() < due) continue; // A resend came first
+        if (next < requests.size()) {
+            const TimedRequest& req = requests[next++];
+            sendRequest(req.floor, req.direction, req.targetFloor);
+            lastSend = clock.now();
+        } else if (retries.empty() && clock.now() >= lastSend + listenAfter) {
+            break;
+        }
+    }
+}
+
+// Parse every request in an input file
+std::vector<TimedRequest> Client::loadRequests(const std::string& filename) {
+    std::vector<TimedRequest> requests;
+
     // Open the file containing requests
     std::ifstream file(filename);
     if (!file.is_open()) {
         std::cerr << "[Client] Error: Unable to open input file: " << filename << std::endl;
-        return;
+        return requests;
     }
 
     std::string line;
-    auto startTime = std::chrono::steady_clock::now(); // Get the start time for timing the requests
 
     // Process each line in the input file
     while (std::getline(file, line)) {
@@ -69,17 +208,18 @@ void Client::processRequestsFromFile(const std::string& filename) {
             std::cerr << "[Client] Error: Invalid request format -> " << line << std::endl;
             continue;
         }
+        if (!isWireFloor(floor) || !isWireFloor(targetFloor)) {
+            std::cerr << "[Client] Error: Floor out of range -> " << line << std::endl;
+            continue;
+        }
 
         // Calculate the delay before sending the request based on the timestamp
-        int delay = getSecondsFromTimestamp(timestamp);
-        std::this_thread::sleep_until(startTime + std::chrono::seconds(delay)); // Sleep until the appropriate time
-
-        // Send the request to the scheduler
-        sendRequest(floor, direction, targetFloor);
+        requests.push_back({getSecondsFromTimestamp(timestamp), floor, direction, targetFloor});
     }
 
-    // Close the file after processing all requests
+    // Close the file after reading all requests
     file.close();
+    return requests;
 }
 
 // Destructor: Close the socket
@@ -87,10 +227,27 @@ Client::~Client() {
     close(sockfd);
 }
 
-#ifndef TEST_BUILD
+#if !defined(TEST_BUILD) && !defined(SIM_BUILD)
 // Main function: Create a client and process requests from an input file
-int main() {
+// ./client [--text] [--shm]
+int main(int argc, char* argv[]) {
+    // ./client [--text] [--shm] [--scheduler <ip[:port]>]
     Client client;
+    struct sockaddr_in addr;
+    bool shm = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--text") client.setBinary(false);
+        else if (arg == "--shm") shm = true;
+        else if (arg == "--scheduler" && i + 1 < argc) {
+            if (!parseEndpoint(argv[++i], SCHEDULER_PORT, addr)) {
+                std::cerr << "--scheduler takes <ipv4>[:<port>]" << std::endl;
+                return 1;
+            }
+            client.setScheduler(addr);
+        }
+    }
+    client.setSharedMemory(shm);
     client.processRequestsFromFile("input.txt"); // Process requests from 'input.txt'
     return 0;
 }
@@ -1,20 +1,72 @@
 #ifndef CLIENT_H
 #define CLIENT_H
 
+#include <deque>
+#include <map>
+#include <memory>
+#include <random>
 #include <string>
+#include <vector>
 #include <netinet/in.h>
+#include "clock.h"
+#include "shm_ring.h"
+#include "wire.h"
+
+#define CLIENT_BACKOFF_BASE_MS 100 // Delay before resending a NAKed request, doubled per attempt
+#define CLIENT_BACKOFF_MAX_MS 8000
+#define CLIENT_MAX_ATTEMPTS 6      // Sends of one request before the client gives up on it
+#define CLIENT_NAK_WAIT_MS 500     // How long the client still listens for NAKs after its last send
+#define CLIENT_SENT_KEPT 256       // Recent requests a NAK can name
+
+// One line of the input file: send the request 'time' seconds after start
+struct TimedRequest {
+    int time;
+    int floor;
+    std::string direction;
+    int targetFloor;
+};
+
+// A request sent, kept so a NAK can find it
+struct SentRequest {
+    uint32_t seq;     // 0 if sent as text
+    TimedRequest req;
+    int attempts;     // Sends so far
+};
 
 class Client {
 
 private:
     int sockfd;
     struct sockaddr_in schedulerAddr;
+    Clock& clock;
+    bool binary = true; // Requests go out in the binary wire format
+    uint32_t sendSeq = 0; // Sequence number of the last request
+    std::unique_ptr<ShmRing> schedulerRing; // Requests go here when set and the scheduler has a ring
+    std::deque<SentRequest> recent;         // The last CLIENT_SENT_KEPT requests, oldest first
+    std::multimap<Clock::time_point, SentRequest> retries; // NAKed requests by when to send them again
+    int attempt = 0;                        // Earlier sends of the request sendRequest() is sending
+    std::minstd_rand jitter;
 public:
-    Client();
+    Client(Clock& clock = Clock::real());
     virtual void sendRequest(int floor, std::string direction, int targetFloor);
     void processRequestsFromFile(const std::string& filename);
-    ~Client();
+    std::vector<TimedRequest> loadRequests(const std::string& filename);
+    virtual ~Client();
     int getSecondsFromTimestamp(const std::string& timestamp);
+    static std::string formatRequest(int floor, const std::string& direction, int targetFloor);
+    std::string encodeRequest(int floor, const std::string& direction, int targetFloor);
+    void setBinary(bool enabled); // False sends text requests, for debugging
+    void setSharedMemory(bool enabled); // Requests go through the scheduler's ring if it has one
+    void setScheduler(const struct sockaddr_in& addr); // SCHEDULER_IP:SCHEDULER_PORT by default
+
+    // Backpressure: a NAK from the scheduler puts the request it names back for
+    // later, after the delay the scheduler asked for or an exponential backoff,
+    // whichever is longer. False if the datagram is no NAK for a recent request.
+    bool handleNak(const char* data, size_t len);
+    void receiveNaks(Clock::time_point until); // Applies NAKs until then, or until a resend is due sooner
+    size_t sendDueRetries();                   // Sends the NAKed requests whose time has come; how many
+    size_t pendingRetries() const;
+    Clock::duration backoff(int attempts, uint32_t retryAfterMs); // Randomised, never under retryAfterMs
     
 };
 
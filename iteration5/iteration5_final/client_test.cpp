@@ -3,6 +3,7 @@
 #include <iostream>
 #include <sstream>
 #include "client.h"
+#include "wire.h"
 
 class MockClient : public Client {
 public:
@@ -20,6 +21,41 @@ TEST(ClientTest, SendsRequestsToScheduler) {
     EXPECT_NE(output.find("Client sent request"), std::string::npos);
 }
 
+TEST(ClientTest, ResendsNakedRequestsWithBackoff) {
+    VirtualClock clock;
+    Client client(clock);
+    testing::internal::CaptureStdout();
+    client.sendRequest(3, "UP", 7); // Binary, seq 1
+
+    // Not before the scheduler's retry-after, and only once per NAK
+    char nak[32];
+    size_t len = putWire(nak, 0, wireHeader(MsgType::NAK, 0, 1, clock.now(), 3, NAK_QUEUE_FULL));
+    len = putWire(nak, len, (uint32_t)300);
+    EXPECT_TRUE(client.handleNak(nak, len));
+    EXPECT_FALSE(client.handleNak(nak, len));
+    EXPECT_EQ(client.pendingRetries(), 1u);
+    clock.sleepFor(std::chrono::milliseconds(299));
+    EXPECT_EQ(client.sendDueRetries(), 0u);
+    clock.sleepFor(std::chrono::milliseconds(1));
+    EXPECT_EQ(client.sendDueRetries(), 1u);
+
+    // A text NAK repeats the request
+    client.setBinary(false);
+    client.sendRequest(5, "DOWN", 1);
+    EXPECT_FALSE(client.handleNak("NAK RATE 0 5 UP 1", 17));
+    EXPECT_TRUE(client.handleNak("NAK RATE 0 5 DOWN 1", 19));
+    EXPECT_EQ(client.pendingRetries(), 1u);
+    testing::internal::GetCapturedStdout();
+
+    // The delay doubles with each refusal, up to a ceiling
+    for (int attempts = 1; attempts <= 10; ++attempts) {
+        long ceiling = std::min<long>(CLIENT_BACKOFF_MAX_MS, (long)CLIENT_BACKOFF_BASE_MS << (attempts - 1));
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(client.backoff(attempts, 0)).count();
+        EXPECT_GE(ms, ceiling / 2);
+        EXPECT_LE(ms, ceiling);
+    }
+}
+
 int main(int argc, char **argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
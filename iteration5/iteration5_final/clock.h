@@ -0,0 +1,85 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Time source shared by the client, scheduler and elevators.
+// RealClock follows the wall clock, VirtualClock runs a discrete-event simulation.
+class Clock {
+public:
+    using duration = std::chrono::steady_clock::duration;
+    using time_point = std::chrono::steady_clock::time_point;
+
+    virtual ~Clock() {}
+    virtual time_point now() const = 0;
+    virtual void sleepUntil(time_point t) = 0;
+    void sleepFor(duration d) { sleepUntil(now() + d); }
+
+    static Clock& real();
+};
+
+class RealClock : public Clock {
+public:
+    time_point now() const override { return std::chrono::steady_clock::now(); }
+    void sleepUntil(time_point t) override { std::this_thread::sleep_until(t); }
+};
+
+inline Clock& Clock::real() {
+    static RealClock clock;
+    return clock;
+}
+
+// Virtual time with an event queue: run() jumps straight to the next event,
+// so a day of traffic takes as long as the CPU needs to process it.
+class VirtualClock : public Clock {
+public:
+    time_point now() const override { return current; }
+    // A blocking sleep just moves virtual time forward
+    void sleepUntil(time_point t) override {
+        if (t > current) current = t;
+    }
+
+    // Events due at the same time run in the order they were scheduled
+    void schedule(time_point at, std::function<void()> fn) {
+        events.push(Event{at < current ? current : at, nextSeq++, std::move(fn)});
+    }
+    void scheduleAfter(duration d, std::function<void()> fn) { schedule(current + d, std::move(fn)); }
+
+    // Runs events in time order until the queue is empty or the next one is past 'until'
+    void run(time_point until = time_point::max()) {
+        while (!events.empty() && events.top().at <= until) {
+            Event ev = events.top();
+            events.pop();
+            current = ev.at;
+            ev.fn();
+            eventCount++;
+        }
+    }
+
+    bool empty() const { return events.empty(); }
+    uint64_t eventsRun() const { return eventCount; }
+
+private:
+    struct Event {
+        time_point at;
+        uint64_t seq;
+        std::function<void()> fn;
+    };
+    struct Later {
+        bool operator()(const Event& a, const Event& b) const {
+            return a.at != b.at ? a.at > b.at : a.seq > b.seq;
+        }
+    };
+
+    std::priority_queue<Event, std::vector<Event>, Later> events;
+    time_point current{};
+    uint64_t nextSeq = 0;
+    uint64_t eventCount = 0;
+};
+
+#endif // CLOCK_H
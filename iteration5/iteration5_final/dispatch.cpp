@@ -0,0 +1,232 @@
+// dispatch.cpp - Nearest-available-car kernels used by Scheduler::findBestElevator
+#include "dispatch.h"
+#include <climits>
+#include <cstdlib>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS 1
+#endif
+
+// Status codes 0 (OK) and 1 (REACHED) mean the car can take a request
+#define AVAILABLE_STATUS_LIMIT 2
+
+int nearestAvailableScalar(const int32_t* floor, const int32_t* load, const int32_t* status,
+                           int count, int reqFloor, int capacity) {
+    int best = -1, minDist = INT_MAX;
+    for (int i = 0; i < count; ++i) {
+        if (static_cast<uint32_t>(status[i]) >= AVAILABLE_STATUS_LIMIT) continue;
+        if (load[i] >= capacity) continue;
+        int dist = std::abs(floor[i] - reqFloor);
+        if (dist < minDist) {
+            minDist = dist;
+            best = i;
+        }
+    }
+    return best;
+}
+
+#ifdef HAVE_X86_KERNELS
+// Eight cars per iteration. Each lane keeps its own minimum and the first slot
+// that reached it, so the lowest slot wins ties exactly like the scalar loop.
+__attribute__((target("avx2")))
+int nearestAvailableAvx2(const int32_t* floor, const int32_t* load, const int32_t* status,
+                         int count, int reqFloor, int capacity) {
+    const __m256i req = _mm256_set1_epi32(reqFloor);
+    const __m256i cap = _mm256_set1_epi32(capacity);
+    const __m256i statusLimit = _mm256_set1_epi32(AVAILABLE_STATUS_LIMIT);
+    const __m256i unavailable = _mm256_set1_epi32(INT_MAX);
+    const __m256i step = _mm256_set1_epi32(8);
+    __m256i slots = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i minDist = unavailable;
+    __m256i minSlot = _mm256_set1_epi32(-1);
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i f = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(floor + i));
+        __m256i l = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(load + i));
+        __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(status + i));
+
+        __m256i available = _mm256_and_si256(_mm256_cmpgt_epi32(statusLimit, s), _mm256_cmpgt_epi32(cap, l));
+        __m256i dist = _mm256_abs_epi32(_mm256_sub_epi32(f, req));
+        dist = _mm256_blendv_epi8(unavailable, dist, available);
+
+        __m256i closer = _mm256_cmpgt_epi32(minDist, dist);
+        minDist = _mm256_blendv_epi8(minDist, dist, closer);
+        minSlot = _mm256_blendv_epi8(minSlot, slots, closer);
+        slots = _mm256_add_epi32(slots, step);
+    }
+
+    alignas(32) int32_t laneDist[8];
+    alignas(32) int32_t laneSlot[8];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(laneDist), minDist);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(laneSlot), minSlot);
+
+    int best = -1, bestDist = INT_MAX;
+    for (int lane = 0; lane < 8; ++lane) {
+        if (laneSlot[lane] < 0) continue;
+        if (laneDist[lane] < bestDist || (laneDist[lane] == bestDist && laneSlot[lane] < best)) {
+            bestDist = laneDist[lane];
+            best = laneSlot[lane];
+        }
+    }
+
+    // Remaining cars have higher slots, so a strict comparison keeps the tie-break
+    for (; i < count; ++i) {
+        if (static_cast<uint32_t>(status[i]) >= AVAILABLE_STATUS_LIMIT) continue;
+        if (load[i] >= capacity) continue;
+        int dist = std::abs(floor[i] - reqFloor);
+        if (dist < bestDist) {
+            bestDist = dist;
+            best = i;
+        }
+    }
+    return best;
+}
+
+bool cpuHasAvx2() {
+    return __builtin_cpu_supports("avx2");
+}
+#else
+int nearestAvailableAvx2(const int32_t* floor, const int32_t* load, const int32_t* status,
+                         int count, int reqFloor, int capacity) {
+    return nearestAvailableScalar(floor, load, status, count, reqFloor, capacity);
+}
+
+bool cpuHasAvx2() {
+    return false;
+}
+#endif
+
+// Sized once for the building, so a car reporting a wild floor cannot make
+// the index grow with it
+void IdleCarIndex::setFloors(int topFloor) {
+    buckets.assign(std::max(0, topFloor) + 1, {});
+    occupied.assign((buckets.size() + 63) / 64, 0);
+    std::fill(indexedFloor.begin(), indexedFloor.end(), NOT_INDEXED);
+    count = 0;
+}
+
+void IdleCarIndex::resize(int cars) {
+    for (int slot = cars; slot < (int)indexedFloor.size(); ++slot) erase(slot);
+    indexedFloor.resize(cars, NOT_INDEXED);
+}
+
+void IdleCarIndex::update(int slot, int floor, bool available) {
+    if (floor < 0 || floor >= (int)buckets.size()) available = false;
+    if (indexedFloor[slot] == (available ? floor : NOT_INDEXED)) return;
+    erase(slot);
+    if (available) insert(slot, floor);
+}
+
+void IdleCarIndex::insert(int slot, int floor) {
+    buckets[floor].insert(slot);
+    occupied[floor / 64] |= 1ULL << (floor % 64);
+    indexedFloor[slot] = floor;
+    count++;
+}
+
+void IdleCarIndex::erase(int slot) {
+    if (indexedFloor[slot] == NOT_INDEXED) return;
+    int bit = indexedFloor[slot];
+    buckets[bit].erase(slot);
+    if (buckets[bit].empty()) occupied[bit / 64] &= ~(1ULL << (bit % 64));
+    indexedFloor[slot] = NOT_INDEXED;
+    count--;
+}
+
+int IdleCarIndex::findUp(int bit) const {
+    int word = bit / 64;
+    if (word >= (int)occupied.size()) return -1;
+    uint64_t bits = occupied[word] & (~0ULL << (bit % 64));
+    while (true) {
+        if (bits) return word * 64 + __builtin_ctzll(bits);
+        if (++word == (int)occupied.size()) return -1;
+        bits = occupied[word];
+    }
+}
+
+int IdleCarIndex::findDown(int bit) const {
+    if (bit < 0) return -1;
+    int word = bit / 64;
+    uint64_t bits = occupied[word] & (~0ULL >> (63 - bit % 64));
+    while (true) {
+        if (bits) return word * 64 + 63 - __builtin_clzll(bits);
+        if (word-- == 0) return -1;
+        bits = occupied[word];
+    }
+}
+
+int IdleCarIndex::nearest(int reqFloor) const {
+    if (count == 0) return -1;
+    long target = reqFloor;
+    int clamped = (int)std::max(0L, std::min(target, (long)buckets.size() - 1));
+    int up = findUp(clamped);
+    int down = findDown(clamped);
+
+    long upDist = up < 0 ? LONG_MAX : std::labs(up - target);
+    long downDist = down < 0 ? LONG_MAX : std::labs(target - down);
+    if (upDist < downDist) return *buckets[up].begin();
+    if (downDist < upDist) return *buckets[down].begin();
+    // Equally close floors above and below: the lowest slot on either wins
+    return std::min(*buckets[up].begin(), *buckets[down].begin());
+}
+
+std::vector<int> solveAssignment(const std::vector<std::vector<long>>& cost) {
+    int rows = (int)cost.size();
+    if (rows == 0) return {};
+    int cols = (int)cost[0].size();
+    const long INF = LONG_MAX / 4;
+
+    // Potentials u (rows) and v (columns); match[col] is the row holding it, 1-based
+    std::vector<long> u(rows + 1, 0), v(cols + 1, 0), minv(cols + 1);
+    std::vector<int> match(cols + 1, 0), way(cols + 1, 0);
+    std::vector<char> used(cols + 1);
+
+    for (int row = 1; row <= rows; ++row) {
+        match[0] = row;
+        int col0 = 0;
+        std::fill(minv.begin(), minv.end(), INF);
+        std::fill(used.begin(), used.end(), 0);
+        // Grow an alternating path from 'row' until it reaches a free column
+        do {
+            used[col0] = 1;
+            int row0 = match[col0], col1 = 0;
+            long delta = INF;
+            for (int col = 1; col <= cols; ++col) {
+                if (used[col]) continue;
+                long reduced = cost[row0 - 1][col - 1] - u[row0] - v[col];
+                if (reduced < minv[col]) {
+                    minv[col] = reduced;
+                    way[col] = col0;
+                }
+                if (minv[col] < delta) {
+                    delta = minv[col];
+                    col1 = col;
+                }
+            }
+            for (int col = 0; col <= cols; ++col) {
+                if (used[col]) {
+                    u[match[col]] += delta;
+                    v[col] -= delta;
+                } else {
+                    minv[col] -= delta;
+                }
+            }
+            col0 = col1;
+        } while (match[col0] != 0);
+        // Flip the path
+        do {
+            int col1 = way[col0];
+            match[col0] = match[col1];
+            col0 = col1;
+        } while (col0 != 0);
+    }
+
+    std::vector<int> assignment(rows, -1);
+    for (int col = 1; col <= cols; ++col) {
+        if (match[col] != 0) assignment[match[col] - 1] = col - 1;
+    }
+    return assignment;
+}
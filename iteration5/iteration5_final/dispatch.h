@@ -0,0 +1,56 @@
+#ifndef DISPATCH_H
+#define DISPATCH_H
+
+#include <cstdint>
+#include <set>
+#include <vector>
+
+// Nearest-available-car kernels over the fleet table's packed int32 columns.
+// A car is available when its status is OK or REACHED (0 or 1) and its load is
+// below 'capacity'. Each kernel returns the slot with the smallest
+// |floor - reqFloor|, the lowest slot on ties, or -1 if no car is available.
+// The scheduler dispatches through IdleCarIndex instead; these full scans are
+// kept as the baseline dispatch_bench measures the index against and as the
+// reference the index is tested against.
+using NearestCarKernel = int (*)(const int32_t* floor, const int32_t* load, const int32_t* status,
+                                 int count, int reqFloor, int capacity);
+
+int nearestAvailableScalar(const int32_t* floor, const int32_t* load, const int32_t* status,
+                           int count, int reqFloor, int capacity);
+int nearestAvailableAvx2(const int32_t* floor, const int32_t* load, const int32_t* status,
+                         int count, int reqFloor, int capacity);
+
+bool cpuHasAvx2(); // Without it nearestAvailableAvx2() runs the scalar loop
+
+// Available cars bucketed by floor. A bitmap marks the floors that hold at least
+// one car, so a nearest-car query scans 64 floors per word outward from the
+// request instead of visiting every car. Ties go to the lowest slot, matching
+// the kernels above.
+class IdleCarIndex {
+public:
+    void setFloors(int topFloor);                     // Floors 0 to topFloor; empties the index
+    void resize(int cars);
+    void update(int slot, int floor, bool available); // Files, moves or removes a car; never one off the floor range
+    int nearest(int reqFloor) const;                  // Slot of the closest car, or -1
+    bool contains(int slot) const { return indexedFloor[slot] != NOT_INDEXED; }
+    int size() const { return count; }
+
+private:
+    static constexpr int32_t NOT_INDEXED = INT32_MIN;
+
+    void insert(int slot, int floor);
+    void erase(int slot);
+    int findUp(int bit) const;   // Lowest occupied floor bit >= bit, or -1
+    int findDown(int bit) const; // Highest occupied floor bit <= bit, or -1
+
+    std::vector<int32_t> indexedFloor;  // Floor each slot is filed under
+    std::vector<std::set<int>> buckets; // Slots per floor, lowest first
+    std::vector<uint64_t> occupied;     // One bit per floor with a non-empty bucket
+    int count = 0;                      // Cars currently indexed
+};
+
+// Min-cost assignment for batch dispatch: cost[row][column] with rows <= columns.
+// Returns the column given to each row (Hungarian algorithm, O(rows^2 * columns)).
+std::vector<int> solveAssignment(const std::vector<std::vector<long>>& cost);
+
+#endif // DISPATCH_H
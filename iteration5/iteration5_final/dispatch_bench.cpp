@@ -0,0 +1,92 @@
+// dispatch_bench.cpp - Dispatch latency of the nearest-car kernels and the idle index against fleet size
+#include "dispatch.h"
+#include "fleet.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#define BENCH_CAPACITY 4
+#define BENCH_FLOORS 100
+#define BENCH_CAR_VISITS 50000000L // Cars scanned per measurement, split across queries
+
+// Fleet with random floors and loads where roughly two thirds of the cars are available
+static FleetTable makeFleet(int cars, std::mt19937& rng) {
+    FleetTable fleet(cars);
+    std::uniform_int_distribution<int> floorDist(0, BENCH_FLOORS);
+    std::uniform_int_distribution<int> loadDist(0, BENCH_CAPACITY);
+    std::uniform_int_distribution<int> statusDist(0, 5);
+    for (int i = 0; i < cars; ++i) {
+        fleet.floor[i] = floorDist(rng);
+        fleet.load[i] = loadDist(rng);
+        int s = statusDist(rng);
+        fleet.status[i] = s < 4 ? ElevatorState(s % 2) : ElevatorState::MOVING;
+    }
+    return fleet;
+}
+
+// Average nanoseconds per dispatch decision
+static double measure(NearestCarKernel kernel, const FleetTable& fleet, const std::vector<int>& queries, long& sink) {
+    const int32_t* status = reinterpret_cast<const int32_t*>(fleet.status.data());
+    long rounds = std::max(1L, BENCH_CAR_VISITS / ((long)fleet.size() * (long)queries.size()));
+    auto start = std::chrono::steady_clock::now();
+    for (long r = 0; r < rounds; ++r) {
+        for (int q : queries) {
+            sink += kernel(fleet.floor.data(), fleet.load.data(), status, fleet.size(), q, BENCH_CAPACITY);
+        }
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / (rounds * queries.size());
+}
+
+// Same measurement for the floor-bucketed idle index
+static double measureIndex(const IdleCarIndex& index, int cars, const std::vector<int>& queries, long& sink) {
+    long rounds = std::max(1L, BENCH_CAR_VISITS / ((long)cars * (long)queries.size()));
+    auto start = std::chrono::steady_clock::now();
+    for (long r = 0; r < rounds; ++r) {
+        for (int q : queries) sink += index.nearest(q);
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / (rounds * queries.size());
+}
+
+int main() {
+    std::mt19937 rng(42);
+    std::vector<int> queries(256);
+    for (int& q : queries) q = rng() % (BENCH_FLOORS + 1);
+
+    std::cout << "AVX2: " << (cpuHasAvx2() ? "yes" : "no, both scans run the scalar loop") << "\n\n";
+    std::cout << "|   Cars | Scalar ns | AVX2 ns | Speedup | Index ns |\n";
+    std::cout << "|--------|-----------|---------|---------|----------|\n";
+
+    long sink = 0;
+    for (int cars = 4; cars <= 16384; cars *= 4) {
+        FleetTable fleet = makeFleet(cars, rng);
+        IdleCarIndex index;
+        index.setFloors(BENCH_FLOORS);
+        index.resize(cars);
+        for (int i = 0; i < cars; ++i) {
+            index.update(i, fleet.floor[i], isAvailable(fleet.status[i]) && fleet.load[i] < BENCH_CAPACITY);
+        }
+        // All three must agree before their timings mean anything
+        for (int q : queries) {
+            const int32_t* status = reinterpret_cast<const int32_t*>(fleet.status.data());
+            int expected = nearestAvailableScalar(fleet.floor.data(), fleet.load.data(), status, cars, q, BENCH_CAPACITY);
+            if (expected != nearestAvailableAvx2(fleet.floor.data(), fleet.load.data(), status, cars, q, BENCH_CAPACITY) ||
+                expected != index.nearest(q)) {
+                std::cerr << "Kernels disagree for " << cars << " cars, floor " << q << std::endl;
+                return 1;
+            }
+        }
+        double scalar = measure(nearestAvailableScalar, fleet, queries, sink);
+        double avx2 = cpuHasAvx2() ? measure(nearestAvailableAvx2, fleet, queries, sink) : scalar;
+        double indexed = measureIndex(index, cars, queries, sink);
+        std::cout << "| " << std::setw(6) << cars << " | " << std::fixed << std::setprecision(1)
+                  << std::setw(9) << scalar << " | " << std::setw(7) << avx2 << " | "
+                  << std::setw(6) << scalar / avx2 << "x | " << std::setw(8) << indexed << " |\n";
+    }
+    return sink == 42 ? 1 : 0; // Keeps the results live
+}
@@ -1,16 +1,74 @@
 #include "elevator.h"
+#include "text_parser.h"
+#include <algorithm>
 #include <cstring>
 #include <arpa/inet.h>
+#include <poll.h>
+#include <sys/timerfd.h>
 #include <unistd.h>
-#include <thread>
 #include <iostream>
-#include <ctime>
 
 #define BASE_PORT 5100
 #define MOVE_TIMEOUT 10  // Timeout in seconds for floor movement
 #define DOOR_RETRY_LIMIT 3  // Number of retries for stuck door
 
-Elevator::Elevator(int elevatorID) : id(elevatorID), currentFloor(0), stuck(false), doorStuck(false) {
+Elevator::Elevator(int elevatorID, Clock& clock)
+    : id(elevatorID), currentFloor(0), sockfd(-1), port(BASE_PORT + elevatorID), stuck(false), doorStuck(false),
+      clock(clock), phase(Phase::IDLE), targetFloor(0), doorRetries(0), stopsDone(0),
+      binary(true), versionFallback(false), sendSeq(0), lastRouteSeq(0), routeEpoch(0), routeSeen(false), sharedMemory(false) {
+    memset(&schedulerAddr, 0, sizeof(schedulerAddr));
+    schedulerAddr.sin_family = AF_INET;
+    schedulerAddr.sin_port = htons(SCHEDULER_PORT);
+    schedulerAddr.sin_addr.s_addr = inet_addr(SCHEDULER_IP);
+}
+
+// Points the timer 'delay' from now; the loop has one timer, so this replaces
+// whatever it was waiting for
+static void armTimer(int timerfd, Clock::duration delay) {
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(delay).count();
+    struct itimerspec spec = {};
+    spec.it_value.tv_sec = ns / 1000000000;
+    spec.it_value.tv_nsec = ns % 1000000000;
+    timerfd_settime(timerfd, 0, &spec, nullptr);
+}
+
+static volatile sig_atomic_t stopSignalled = 0;
+
+static void onStopSignal(int) {
+    stopSignalled = 1;
+}
+
+// The signals stay blocked except inside ppoll()/epoll_pwait() with
+// waitMask(), so one cannot slip in between checking stopRequested() and
+// going to sleep. No SA_RESTART, so the wait returns EINTR.
+void Elevator::stopOnSignals() {
+    struct sigaction action = {};
+    action.sa_handler = onStopSignal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    sigset_t blocked;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGINT);
+    sigaddset(&blocked, SIGTERM);
+    sigprocmask(SIG_BLOCK, &blocked, nullptr);
+}
+
+bool Elevator::stopRequested() {
+    return stopSignalled != 0;
+}
+
+const sigset_t* Elevator::waitMask() {
+    static sigset_t none = [] {
+        sigset_t set;
+        sigemptyset(&set);
+        return set;
+    }();
+    return &none;
+}
+
+// Binds the elevator port and serves commands until a hard fault or a stop signal
+void Elevator::start() {
     sockfd = socket(AF_INET, SOCK_DGRAM, 0);
     if (sockfd < 0) {
         perror("[Elevator] Socket creation failed");
@@ -21,86 +79,346 @@ Elevator::Elevator(int elevatorID) : id(elevatorID), currentFloor(0), stuck(fals
     memset(&selfAddr, 0, sizeof(selfAddr));
     selfAddr.sin_family = AF_INET;
     selfAddr.sin_addr.s_addr = INADDR_ANY;
-    selfAddr.sin_port = htons(BASE_PORT + id);
+    selfAddr.sin_port = htons(port);
 
-    if (bind(sockfd, (struct sockaddr*)&selfAddr, sizeof(selfAddr)) < 0) {
+    socklen_t addrLen = sizeof(selfAddr);
+    if (bind(sockfd, (struct sockaddr*)&selfAddr, sizeof(selfAddr)) < 0 ||
+        getsockname(sockfd, (struct sockaddr*)&selfAddr, &addrLen) < 0) {
         perror("[Elevator] Bind failed");
         exit(EXIT_FAILURE);
     }
+    port = ntohs(selfAddr.sin_port); // The one picked if any port would do
+    if (sharedMemory) {
+        commandRing = ShmRing::create(port);
+        if (!commandRing) perror("[Elevator] Shared-memory ring unavailable, using UDP only");
+        sharedMemory = commandRing != nullptr;
+        ShmRing::refresh(schedulerRing, ntohs(schedulerAddr.sin_port));
+    }
 
-    memset(&schedulerAddr, 0, sizeof(schedulerAddr));
-    schedulerAddr.sin_family = AF_INET;
-    schedulerAddr.sin_port = htons(SCHEDULER_PORT);
-    schedulerAddr.sin_addr.s_addr = inet_addr(SCHEDULER_IP);
-
-    std::cout << "[Elevator " << id << "] Listening on port " << (BASE_PORT + id) << std::endl;
+    std::cout << "[Elevator " << id << "] Listening on port " << port << std::endl;
+    sendHello(); // Also tells the scheduler which format this car speaks
+    runEventLoop();
+    if (stopRequested()) sendReport(MsgType::BYE);
 }
 
-void Elevator::receiveCommand() {
+// Sleeps in poll() until a command arrives or the timer fires. Commands are
+// applied as soon as they are read, mid-trip included, from the socket or,
+// with shared memory, the car's ring, which rings a doorbell on the socket. The timer paces a trip
+// one STEP_DELAY at a time, and while the car is idle it sends a HEARTBEAT
+// after HEARTBEAT_DELAY seconds without a report. STATUS only goes out when a
+// command leaves the car idle or a route is finished.
+void Elevator::runEventLoop() {
+    int timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    if (timerfd < 0) {
+        perror("[Elevator] timerfd_create failed");
+        exit(EXIT_FAILURE);
+    }
+    armTimer(timerfd, std::chrono::seconds(HEARTBEAT_DELAY));
+    struct pollfd fds[2] = {{sockfd, POLLIN, 0}, {timerfd, POLLIN, 0}};
     char buffer[BUFFER_SIZE];
-    struct sockaddr_in sender;
-    socklen_t len = sizeof(sender);
+    auto apply = [&](const char* data, size_t len) {
+        bool stops = handleCommand(std::string(data, len));
+        if (phase != Phase::IDLE) return; // Already under way; the route took effect
+        if (stops && beginNextStop()) {
+            armTimer(timerfd, std::chrono::seconds(STEP_DELAY));
+        } else {
+            sendStatus();
+            armTimer(timerfd, std::chrono::seconds(HEARTBEAT_DELAY));
+        }
+    };
+    const struct timespec noWait = {0, 0};
 
-    int n = recvfrom(sockfd, buffer, BUFFER_SIZE - 1, 0, (struct sockaddr*)&sender, &len);
-    if (n <= 0) return;
-    buffer[n] = '\0';
+    while (!stuck && !stopRequested()) {
+        bool sleep = !commandRing || commandRing->readyToSleep();
+        if (ppoll(fds, 2, sleep ? nullptr : &noWait, waitMask()) < 0) continue;
+        if (commandRing) {
+            commandRing->awake();
+            commandRing->drain(apply);
+        }
 
-    int eid, targetFloor;
-    if (sscanf(buffer, "MOVE %d %d", &eid, &targetFloor) == 2 && eid == id) {
-        std::cout << "[Elevator " << id << "] Received move command to Floor " << targetFloor << std::endl;
-        moveTo(targetFloor);
+        if (fds[0].revents & POLLIN) {
+            int n;
+            while ((n = recvfrom(sockfd, buffer, BUFFER_SIZE - 1, MSG_DONTWAIT, nullptr, nullptr)) >= 0) {
+                if (n > 0) apply(buffer, n); // Empty, it is only a doorbell
+            }
+        }
+
+        if (fds[1].revents & POLLIN) {
+            uint64_t expirations;
+            if (read(timerfd, &expirations, sizeof(expirations)) <= 0) continue;
+            if (phase == Phase::IDLE) {
+                if (sharedMemory) ShmRing::refresh(schedulerRing, ntohs(schedulerAddr.sin_port));
+                sendReport(MsgType::HEARTBEAT);
+                armTimer(timerfd, std::chrono::seconds(HEARTBEAT_DELAY));
+            } else if (step()) {
+                armTimer(timerfd, std::chrono::seconds(STEP_DELAY));
+            } else if (!stuck) {
+                completeStop();
+                if (beginNextStop()) {
+                    armTimer(timerfd, std::chrono::seconds(STEP_DELAY));
+                } else {
+                    sendStatus();
+                    armTimer(timerfd, std::chrono::seconds(HEARTBEAT_DELAY));
+                }
+            }
+        }
     }
+    close(timerfd);
 }
 
-void Elevator::moveTo(int floor) {
-    std::cout << "[Elevator " << id << "] Doors closing..." << std::endl;
-    
-    int retryCount = 0;
-    while (retryCount < DOOR_RETRY_LIMIT) {
-        sleep(1);
-        if (rand() % 10 < 8) {  // Simulating an 80% chance of successful door closure
-            break;
+// "MOVE <id> <floor>" is a one-stop itinerary. "ROUTE <id> <seen> <floor>..."
+// replaces the itinerary; <seen> is how many ARRIVED reports the scheduler had
+// when it built the route, so stops finished since then are dropped from its front.
+// Malformed commands are ignored as a whole.
+bool Elevator::handleCommand(const std::string& cmd) {
+    if (isWireMessage(cmd.data(), cmd.size())) return handleWireCommand(cmd.data(), cmd.size());
+    TextReader in(cmd);
+    std::string_view type = in.word();
+    int eid, floor, seen;
+    if (type == "ROUTE") {
+        if (!in.integer(eid) || eid != id || !in.integer(seen)) return false;
+        std::deque<int> stops;
+        while (!in.atEnd()) {
+            if (!in.integer(floor)) return false;
+            stops.push_back(floor);
         }
-        std::cerr << "[Elevator " << id << "] Warning: Door failed to close, retrying..." << std::endl;
-        retryCount++;
+        for (int done = stopsDone - seen; done > 0 && !stops.empty(); --done) stops.pop_front();
+        itinerary.swap(stops);
+        followItinerary();
+        std::cout << "[Elevator " << id << "] Received route with " << itinerary.size() << " stops" << std::endl;
+        return !itinerary.empty();
     }
+    if (type == "MOVE" && in.integer(eid) && eid == id && in.integer(floor) && in.atEnd()) {
+        std::cout << "[Elevator " << id << "] Received move command to Floor " << floor << std::endl;
+        itinerary.assign(1, floor);
+        followItinerary();
+        return true;
+    }
+    return false;
+}
+
+// Binary ROUTE: header, uint32 <seen>, uint32 epoch, then the stops as int16.
+// Every copy is acknowledged, but only a route newer than the last one is
+// applied, so a retransmission or a late duplicate changes nothing. Sequence
+// numbers only compare within one scheduler's epoch: the first route from a
+// restarted scheduler starts the window again. A message for this car from a
+// scheduler on another version switches the car to text, starting with a
+// STATUS so the route is resent in text, until a route of this version comes.
+// Any other datagram that does not parse is dropped.
+bool Elevator::handleWireCommand(const char* data, size_t len) {
+    WireHeader header;
+    if (!readWireHeader(data, len, header)) {
+        header = getWire<WireHeader>(data, 0); // The caller checked it is long enough
+        if (binary && header.version != WIRE_VERSION && header.elevatorID == id) {
+            binary = false;
+            versionFallback = true;
+            sendStatus();
+        }
+        return false;
+    }
+    if (header.type != MsgType::ROUTE || header.elevatorID != id) return false;
+    if (versionFallback) {
+        binary = true;
+        versionFallback = false;
+    }
+    sendAck(header.seq); // Also for a copy already applied, in case the first ACK was lost
+    uint32_t epoch = getWire<uint32_t>(data, sizeof(WireHeader) + sizeof(uint32_t));
+    if (routeSeen && epoch == routeEpoch && lastRouteSeq - header.seq < WIRE_REPLAY_WINDOW) return false;
+    lastRouteSeq = header.seq;
+    routeEpoch = epoch;
+    routeSeen = true;
+    int seen = (int)getWire<uint32_t>(data, sizeof(WireHeader));
+    std::deque<int> stops;
+    size_t at = sizeof(WireHeader) + 2 * sizeof(uint32_t);
+    for (int i = 0; i < header.aux; ++i, at += sizeof(int16_t)) stops.push_back(getWire<int16_t>(data, at));
+    for (int done = stopsDone - seen; done > 0 && !stops.empty(); --done) stops.pop_front();
+    itinerary.swap(stops);
+    followItinerary();
+    std::cout << "[Elevator " << id << "] Received route with " << itinerary.size() << " stops" << std::endl;
+    return !itinerary.empty();
+}
 
-    if (retryCount == DOOR_RETRY_LIMIT) {
-        std::cerr << "[Elevator " << id << "] Warning: Door was stuck but finally closed." << std::endl;
-        sendFaultMessage("WARNING " + std::to_string(id) + " DOOR_STUCK");
+// A route that changes during a trip takes effect at once. Until the car
+// reaches its stop it heads from the floor it is at for the new first stop,
+// which may be a floor it is about to pass. Once the doors are opening the
+// stop is being made, so it stays first and is not visited again later.
+void Elevator::followItinerary() {
+    if (phase == Phase::IDLE) return;
+    if (phase == Phase::DOORS_OPENING || itinerary.empty()) {
+        auto made = std::find(itinerary.begin(), itinerary.end(), targetFloor);
+        if (made != itinerary.end()) itinerary.erase(made);
+        itinerary.push_front(targetFloor);
+        return;
     }
+    if (itinerary.front() == targetFloor) return;
+    std::cout << "[Elevator " << id << "] Retargeted from Floor " << targetFloor << " to Floor "
+              << itinerary.front() << std::endl;
+    targetFloor = itinerary.front();
+    tripStart = clock.now(); // The timeout covers the new leg
+}
 
-    auto startTime = time(nullptr);
-    if (floor > currentFloor) {
-        for (int f = currentFloor + 1; f <= floor; f++) {
-            std::cout << "[Elevator " << id << "] Moving up... Floor " << f << std::endl;
-            sleep(1);
-            if (time(nullptr) - startTime > MOVE_TIMEOUT) {
-                reportHardFault();
-                return;
-            }
+bool Elevator::beginNextStop() {
+    if (itinerary.empty()) return false;
+    beginMove(itinerary.front());
+    return true;
+}
+
+void Elevator::completeStop() {
+    itinerary.pop_front();
+    stopsDone++;
+    sendArrival();
+}
+
+void Elevator::beginMove(int floor) {
+    std::cout << "[Elevator " << id << "] Doors closing..." << std::endl;
+    targetFloor = floor;
+    doorRetries = 0;
+    phase = Phase::DOORS_CLOSING;
+}
+
+// Runs the phase that completes after one STEP_DELAY; returns false once the trip is over
+bool Elevator::step() {
+    switch (phase) {
+    case Phase::DOORS_CLOSING:
+        if (doorRng() % 10 >= 8) {  // Simulating an 80% chance of successful door closure
+            std::cerr << "[Elevator " << id << "] Warning: Door failed to close, retrying..." << std::endl;
+            if (++doorRetries < DOOR_RETRY_LIMIT) return true;
+            std::cerr << "[Elevator " << id << "] Warning: Door was stuck but finally closed." << std::endl;
+            sendReport(MsgType::WARNING, WARN_DOOR_STUCK);
         }
-    } else if (floor < currentFloor) {
-        for (int f = currentFloor - 1; f >= floor; f--) {
-            std::cout << "[Elevator " << id << "] Moving down... Floor " << f << std::endl;
-            sleep(1);
-            if (time(nullptr) - startTime > MOVE_TIMEOUT) {
-                reportHardFault();
-                return;
-            }
+        tripStart = clock.now();
+        if (targetFloor == currentFloor) {
+            std::cout << "[Elevator " << id << "] Doors opening..." << std::endl;
+            phase = Phase::DOORS_OPENING;
+            return true;
+        }
+        phase = Phase::MOVING;
+        break;
+
+    case Phase::MOVING:
+        if (std::chrono::duration_cast<std::chrono::seconds>(clock.now() - tripStart).count() > MOVE_TIMEOUT) {
+            reportHardFault();
+            phase = Phase::IDLE;
+            return false;
         }
+        if (currentFloor == targetFloor) {
+            std::cout << "[Elevator " << id << "] Doors opening..." << std::endl;
+            phase = Phase::DOORS_OPENING;
+            return true;
+        }
+        break;
+
+    case Phase::DOORS_OPENING:
+        std::cout << "[Elevator " << id << "] Arrived at Floor " << currentFloor << std::endl;
+        phase = Phase::IDLE;
+        return false;
+
+    case Phase::IDLE:
+        return false;
     }
 
-    currentFloor = floor;
-    std::cout << "[Elevator " << id << "] Doors opening..." << std::endl;
-    sleep(1);
-    std::cout << "[Elevator " << id << "] Arrived at Floor " << currentFloor << std::endl;
+    // Travel one more floor towards the target and say where the car is now
+    if (targetFloor > currentFloor) {
+        currentFloor++;
+        std::cout << "[Elevator " << id << "] Moving up... Floor " << currentFloor << std::endl;
+    } else {
+        currentFloor--;
+        std::cout << "[Elevator " << id << "] Moving down... Floor " << currentFloor << std::endl;
+    }
+    sendReport(MsgType::POSITION);
+    return true;
 }
 
 
 void Elevator::sendStatus() {
-    std::string msg = "STATUS " + std::to_string(id) + " " + std::to_string(currentFloor);
-    sendto(sockfd, msg.c_str(), msg.size(), 0, (struct sockaddr*)&schedulerAddr, sizeof(schedulerAddr));
+    sendReport(MsgType::STATUS);
+}
+
+// Per-stop completion: "ARRIVED <id> <floor>"
+void Elevator::sendArrival() {
+    sendReport(MsgType::ARRIVED);
+}
+
+// Sends a report as a 16-byte binary message, plus the flags for a WARNING,
+// or in text when binary is off
+void Elevator::sendReport(MsgType type, uint32_t warnings) {
+    if (!binary) {
+        std::string msg = formatReport(type, id, currentFloor, warnings);
+        transmit(msg.c_str(), msg.size());
+        return;
+    }
+    char msg[sizeof(WireHeader) + sizeof(uint32_t)];
+    size_t len = putWire(msg, 0, wireHeader(type, id, ++sendSeq, clock.now(), currentFloor));
+    if (type == MsgType::WARNING) len = putWire(msg, len, warnings);
+    transmit(msg, len);
+}
+
+// "HELLO <id> <floor> <ipv4> <port> <capabilities>". The address is left as
+// 0.0.0.0, so the scheduler answers the host the HELLO came from.
+void Elevator::sendHello() {
+    uint32_t caps = CAP_ROUTE_ACK | (sharedMemory ? CAP_SHM : CAP_NONE);
+    if (!binary) {
+        std::string msg = "HELLO " + std::to_string(id) + " " + std::to_string(currentFloor) + " 0.0.0.0 " +
+                          std::to_string(port) + " " + std::to_string(caps);
+        transmit(msg.c_str(), msg.size());
+        return;
+    }
+    char msg[sizeof(WireHeader) + 2 * sizeof(uint32_t) + sizeof(uint16_t)];
+    size_t len = putWire(msg, 0, wireHeader(MsgType::HELLO, id, ++sendSeq, clock.now(), currentFloor));
+    len = putWire(msg, len, caps);
+    len = putWire(msg, len, (uint32_t)0);
+    len = putWire(msg, len, (uint16_t)port);
+    transmit(msg, len);
+}
+
+// "Route <seq> received"; binary only, as text routes carry no sequence number
+void Elevator::sendAck(uint32_t seq) {
+    char msg[sizeof(WireHeader) + sizeof(uint32_t)];
+    size_t len = putWire(msg, 0, wireHeader(MsgType::ACK, id, ++sendSeq, clock.now(), currentFloor));
+    len = putWire(msg, len, seq);
+    transmit(msg, len);
+}
+
+void Elevator::transmit(const char* msg, size_t len) {
+    if (schedulerRing && schedulerRing->send(sockfd, schedulerAddr, msg, len)) return;
+    sendto(sockfd, msg, len, 0, (struct sockaddr*)&schedulerAddr, sizeof(schedulerAddr));
+}
+
+// Text form of a report: "STATUS <id> <floor>", "ARRIVED <id> <floor>",
+// "POSITION <id> <floor>", "HEARTBEAT <id> <floor>", "FAULT <id>",
+// "BYE <id>" or "WARNING <id> <name>"
+std::string Elevator::formatReport(MsgType type, int id, int floor, uint32_t warnings) {
+    std::string car = std::to_string(id);
+    switch (type) {
+    case MsgType::STATUS: return "STATUS " + car + " " + std::to_string(floor);
+    case MsgType::ARRIVED: return "ARRIVED " + car + " " + std::to_string(floor);
+    case MsgType::POSITION: return "POSITION " + car + " " + std::to_string(floor);
+    case MsgType::HEARTBEAT: return "HEARTBEAT " + car + " " + std::to_string(floor);
+    case MsgType::FAULT: return "FAULT " + car;
+    case MsgType::BYE: return "BYE " + car;
+    default: return "WARNING " + car + " " + warningName(warnings);
+    }
+}
+
+void Elevator::setBinary(bool enabled) {
+    binary = enabled;
+    versionFallback = false;
+}
+
+void Elevator::setSharedMemory(bool enabled) {
+    sharedMemory = enabled;
+}
+
+void Elevator::setScheduler(const struct sockaddr_in& addr) {
+    schedulerAddr = addr;
+}
+
+void Elevator::setPort(int commandPort) {
+    port = commandPort;
+}
+
+int Elevator::getPort() const {
+    return port;
 }
 
 int Elevator::getCurrentFloor() const {
@@ -111,33 +429,51 @@ int Elevator::getID() const {
     return id;
 }
 
-void Elevator::sendFaultMessage(const std::string& msg) {
-    sendto(sockfd, msg.c_str(), msg.size(), 0, (struct sockaddr*)&schedulerAddr, sizeof(schedulerAddr));
+bool Elevator::isStuck() const {
+    return stuck;
+}
+
+const std::deque<int>& Elevator::getItinerary() const {
+    return itinerary;
 }
 
 void Elevator::reportHardFault() {
-    std::cerr << "[Elevator " << id << "] HARD FAULT: Movement timeout. Shutting down." << std::endl;
-    sendFaultMessage("FAULT " + std::to_string(id));
-    exit(EXIT_FAILURE);
+    std::cerr << "[Elevator " << id << "] HARD FAULT: Movement timeout. Out of service until stopped." << std::endl;
+    sendReport(MsgType::FAULT);
+    stuck = true;
 }
 
 Elevator::~Elevator() {
-    close(sockfd);
+    if (sockfd >= 0) close(sockfd);
 }
 
-#ifndef TEST_BUILD
+#if !defined(TEST_BUILD) && !defined(SIM_BUILD) && !defined(HOST_BUILD)
 int main(int argc, char* argv[]) {
-    if (argc != 2) {
-        std::cerr << "Usage: ./elevator <id>" << std::endl;
+    if (argc < 2) {
+        std::cerr << "Usage: ./elevator <id> [--text] [--port <port>] [--shm] [--scheduler <ip[:port]>]" << std::endl;
         return 1;
     }
-
     Elevator elevator(std::atoi(argv[1]));
-    while (true) {
-        elevator.receiveCommand();
-        elevator.sendStatus();
-        sleep(2);
+    struct sockaddr_in addr;
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--text") {
+            elevator.setBinary(false);
+        } else if (arg == "--port" && i + 1 < argc) {
+            elevator.setPort(std::atoi(argv[++i])); // 0 lets the system pick
+        } else if (arg == "--shm") {
+            elevator.setSharedMemory(true);
+        } else if (arg == "--scheduler" && i + 1 < argc && parseEndpoint(argv[i + 1], SCHEDULER_PORT, addr)) {
+            elevator.setScheduler(addr); // Where reports go; HELLO tells it where this car is
+            ++i;
+        } else {
+            std::cerr << "Usage: ./elevator <id> [--text] [--port <port>] [--shm] [--scheduler <ip[:port]>]" << std::endl;
+            return 1;
+        }
     }
-    return 0;
+
+    Elevator::stopOnSignals();
+    elevator.start();
+    return elevator.isStuck() ? EXIT_FAILURE : 0; // Stopped by a signal after saying BYE
 }
 #endif
@@ -1,41 +1,99 @@
 #ifndef ELEVATOR_H
 #define ELEVATOR_H
 
+#include <deque>
+#include <memory>
 #include <netinet/in.h>
+#include <random>
+#include <signal.h>
 #include <string>
+#include "clock.h"
+#include "shm_ring.h"
+#include "wire.h"
 
 #define BASE_PORT 5100
 #define SCHEDULER_PORT 5002
 #define SCHEDULER_IP "127.0.0.1"
 #define BUFFER_SIZE 1024
+#define STEP_DELAY 1  // Seconds per door attempt, per floor and for the doors to open
+#define HEARTBEAT_DELAY 30 // Seconds an idle car stays silent before it sends a HEARTBEAT
 
 class Elevator {
 private:
+    // Phases of a trip, each one lasting STEP_DELAY seconds
+    enum class Phase { IDLE, DOORS_CLOSING, MOVING, DOORS_OPENING };
+
     int id;
     int currentFloor;
     int movementCount;
     int capacity;
     int load;
     int sockfd;
+    int port;          // Where commands are received, announced in HELLO
     bool stuck;
     bool doorStuck;
     struct sockaddr_in schedulerAddr;
 
+    Clock& clock;
+    std::minstd_rand doorRng; // Per-car so door faults replay the same way in simulation
+    Phase phase;
+    int targetFloor;
+    int doorRetries;
+    Clock::time_point tripStart;
+    std::deque<int> itinerary; // Stops still to make, in order
+    int stopsDone;             // ARRIVED reports sent so far
+    bool binary;               // Reports go out in the binary wire format
+    bool versionFallback;      // Sending text because the scheduler spoke another version
+    uint32_t sendSeq;          // Sequence number of the last report
+    uint32_t lastRouteSeq;     // Scheduler's sequence number of the last ROUTE applied
+    uint32_t routeEpoch;       // Epoch of the scheduler that sent that ROUTE
+    bool routeSeen;            // lastRouteSeq and routeEpoch are set
+    bool sharedMemory;         // Commands may come through a ring; announced as CAP_SHM
+    std::unique_ptr<ShmRing> commandRing;   // Named after the port, read by this car
+    std::unique_ptr<ShmRing> schedulerRing; // Reports go here when the scheduler has one
+
+    void runEventLoop(); // start(): commands, trip steps and heartbeats on poll and a timerfd
+    void followItinerary(); // Points a trip in progress at the first stop of a new route
+    bool handleWireCommand(const char* data, size_t len); // Binary form of handleCommand()
+    void sendAck(uint32_t seq); // Acknowledges a binary ROUTE
+
 public:
-    Elevator(int elevatorID);
-    ~Elevator();
+    Elevator(int elevatorID, Clock& clock = Clock::real());
+    virtual ~Elevator();
 
-    virtual void receiveCommand();
-    void moveTo(int floor);
+    void start(); // Serves commands until a hard fault or stopOnSignals() fires
+    bool handleCommand(const std::string& cmd); // Applies a MOVE or ROUTE in either format; true if there are stops to make
+    bool beginNextStop(); // Starts the trip to the next stop, false if there is none
+    void completeStop();  // Reports the stop just reached and drops it from the itinerary
+    void beginMove(int floor);
+    bool step();
     virtual void sendStatus();
+    virtual void sendArrival();
     void reportHardFault();
-    void sendFaultMessage(const std::string& message);
-    
+    void sendHello(); // Registers the car, with its port, floor and capabilities
+    virtual void sendReport(MsgType type, uint32_t warnings = WARN_NONE); // Any report a car sends to the scheduler
+    static std::string formatReport(MsgType type, int id, int floor, uint32_t warnings = WARN_NONE);
+    void setBinary(bool enabled); // False sends text reports, for debugging
+    void setPort(int commandPort); // Before start(); 0 binds any free port. BASE_PORT + ID by default
+    void setSharedMemory(bool enabled); // Before start(); trade messages through rings with a scheduler on this host
+    void setScheduler(const struct sockaddr_in& addr); // Before start(); SCHEDULER_IP:SCHEDULER_PORT by default
+
+    // SIGINT and SIGTERM then end the event loop instead of the process, so cars
+    // can send BYE; the signals are only taken while the loop is waiting
+    static void stopOnSignals();
+    static bool stopRequested();
+    static const sigset_t* waitMask(); // Signal mask to wait with: everything unblocked
+
     int getID() const;
+    int getPort() const;
     int getCurrentFloor() const;
     int getMovementCount() const;
     int getLoad() const;
+    bool isStuck() const;
+    const std::deque<int>& getItinerary() const;
+
+protected:
+    virtual void transmit(const char* msg, size_t len); // Sends one encoded report to the scheduler
 };
 
 #endif // ELEVATOR_H
-
@@ -0,0 +1,353 @@
+// elevator_host.cpp - Many elevators in one process, multiplexed on one event loop
+#include "elevator_host.h"
+#include "text_parser.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+HostedElevator::HostedElevator(ElevatorHost& host, int id, Clock& clock) : Elevator(id, clock), host(host) {
+    task = run(); // Runs up to the first nextCommand()
+}
+
+// As in Elevator::runEventLoop(), a command reaching a car mid-trip takes effect at once
+void HostedElevator::deliver(const std::string& cmd) {
+    if (task.done()) return; // The real process has exited after a hard fault
+    if (!awaitingCommand) {
+        handleCommand(cmd);
+        return;
+    }
+    inbox.push_back(cmd);
+    awaitingCommand = false;
+    std::exchange(resume, {}).resume();
+}
+
+void HostedElevator::heartbeat() {
+    if (awaitingCommand) sendReport(MsgType::HEARTBEAT);
+}
+
+void HostedElevator::leave() {
+    if (!task.done()) sendReport(MsgType::BYE);
+}
+
+void HostedElevator::wake() {
+    if (resume && !awaitingCommand) std::exchange(resume, {}).resume();
+}
+
+// Same as Elevator::runEventLoop(): each phase of step() takes STEP_DELAY, and
+// a command either starts a trip or is answered with a STATUS
+CarTask HostedElevator::run() {
+    while (true) {
+        std::string cmd = co_await nextCommand();
+        if (handleCommand(cmd)) {
+            while (beginNextStop()) {
+                do {
+                    co_await sleep(STEP_DELAY);
+                } while (step());
+                if (isStuck()) co_return;
+                completeStop();
+            }
+        }
+        sendStatus();
+    }
+}
+
+HostedElevator::Sleep HostedElevator::sleep(int seconds) {
+    return Sleep{*this, std::chrono::seconds(seconds)};
+}
+
+HostedElevator::NextCommand HostedElevator::nextCommand() {
+    return NextCommand{*this};
+}
+
+void HostedElevator::Sleep::await_suspend(std::coroutine_handle<> h) {
+    car.resume = h;
+    car.host.wakeAfter(car.getID(), delay);
+}
+
+void HostedElevator::NextCommand::await_suspend(std::coroutine_handle<> h) {
+    car.resume = h;
+    car.awaitingCommand = true;
+}
+
+std::string HostedElevator::NextCommand::await_resume() {
+    std::string cmd = std::move(car.inbox.front());
+    car.inbox.pop_front();
+    return cmd;
+}
+
+void HostedElevator::transmit(const char* msg, size_t len) {
+    host.queueReport(msg, len);
+}
+
+ElevatorHost::ElevatorHost(int firstID, int count, Clock& clock)
+    : firstID(firstID), clock(clock), nextHeartbeat(clock.now() + std::chrono::seconds(HEARTBEAT_DELAY)) {
+    parseEndpoint(SCHEDULER_IP, SCHEDULER_PORT, schedulerAddr);
+    for (int id = firstID; id < firstID + count; ++id) {
+        cars.push_back(std::make_unique<HostedElevator>(*this, id, clock));
+    }
+}
+
+ElevatorHost::~ElevatorHost() {
+    if (sockfd >= 0) close(sockfd);
+    if (epfd >= 0) close(epfd);
+    if (timerfd >= 0) close(timerfd);
+}
+
+void ElevatorHost::start() {
+    openSocket();
+    std::cout << "[Host] Running elevators " << firstID << " to " << (firstID + (int)cars.size() - 1)
+              << " on port " << port << std::endl;
+    for (auto& car : cars) {
+        car->setPort(port);
+        car->setSharedMemory(sharedMemory); // Cars announce the host's ring
+        car->sendHello(); // Also tells the scheduler which format each car speaks
+    }
+    flushReports();
+    runEventLoop();
+    for (auto& car : cars) car->leave();
+    flushReports();
+}
+
+void ElevatorHost::openSocket() {
+    epfd = epoll_create1(0);
+    timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    sockfd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    if (epfd < 0 || timerfd < 0 || sockfd < 0) {
+        perror("[Host] Socket creation failed");
+        exit(EXIT_FAILURE);
+    }
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(port);
+    socklen_t addrLen = sizeof(addr);
+    if (bind(sockfd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+        getsockname(sockfd, (struct sockaddr*)&addr, &addrLen) < 0) {
+        perror("[Host] Bind failed"); // perror, so it shows even with --quiet
+        exit(EXIT_FAILURE);
+    }
+    port = ntohs(addr.sin_port);
+    if (sharedMemory) {
+        commandRing = ShmRing::create(port);
+        if (!commandRing) perror("[Host] Shared-memory ring unavailable, using UDP only");
+        sharedMemory = commandRing != nullptr;
+        ShmRing::refresh(schedulerRing, ntohs(schedulerAddr.sin_port));
+    }
+
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.fd = timerfd;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, timerfd, &ev);
+    ev.data.fd = sockfd;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, sockfd, &ev);
+}
+
+// One thread for every car: sleeps in epoll_pwait until a command arrives or
+// the earliest car's timer fires, then sends whatever the cars reported.
+// Commands in the host's ring are taken after every wait.
+void ElevatorHost::runEventLoop() {
+    struct epoll_event events[HOST_EVENTS];
+    while (!Elevator::stopRequested()) {
+        int timeoutMs = !commandRing || commandRing->readyToSleep() ? -1 : 0;
+        int n = epoll_pwait(epfd, events, HOST_EVENTS, timeoutMs, Elevator::waitMask());
+        if (commandRing) {
+            commandRing->awake();
+            commandRing->drain([this](const char* data, size_t len) { deliver(data, len); });
+        }
+        for (int i = 0; i < n; ++i) {
+            if (events[i].data.fd == timerfd) {
+                uint64_t expirations;
+                while (read(timerfd, &expirations, sizeof(expirations)) > 0) {}
+            } else {
+                drainSocket();
+            }
+        }
+        runDueTimers();
+        armTimer();
+        flushReports();
+    }
+}
+
+void ElevatorHost::drainSocket() {
+    static char buffers[HOST_RECV_BATCH][BUFFER_SIZE];
+    struct mmsghdr msgs[HOST_RECV_BATCH];
+    struct iovec iovs[HOST_RECV_BATCH];
+    while (true) {
+        for (int i = 0; i < HOST_RECV_BATCH; ++i) {
+            iovs[i] = {buffers[i], BUFFER_SIZE - 1};
+            msgs[i] = {};
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        int n = recvmmsg(sockfd, msgs, HOST_RECV_BATCH, MSG_DONTWAIT, nullptr);
+        if (n <= 0) return;
+        for (int i = 0; i < n; ++i) {
+            if (msgs[i].msg_len > 0) deliver(buffers[i], msgs[i].msg_len); // Empty, it is only a doorbell
+        }
+        if (n < HOST_RECV_BATCH) return;
+    }
+}
+
+// Commands are demultiplexed on the elevator ID they carry
+void ElevatorHost::deliver(const char* data, size_t len) {
+    HostedElevator* target = car(commandElevatorID(data, len));
+    if (!target) {
+        rejectedDatagrams++;
+        return;
+    }
+    target->deliver(std::string(data, len));
+}
+
+void ElevatorHost::wakeAfter(int id, Clock::duration delay) {
+    timers.push({clock.now() + delay, timerSeq++, id});
+}
+
+void ElevatorHost::runDueTimers() {
+    Clock::time_point now = clock.now();
+    while (!timers.empty() && timers.top().at <= now) {
+        int id = timers.top().id;
+        timers.pop();
+        car(id)->wake(); // May schedule this car again
+    }
+    // One heartbeat round for all idle cars, so they go out in a few sendmmsg calls
+    if (now >= nextHeartbeat) {
+        if (sharedMemory) ShmRing::refresh(schedulerRing, ntohs(schedulerAddr.sin_port));
+        for (auto& car : cars) car->heartbeat();
+        nextHeartbeat = now + std::chrono::seconds(HEARTBEAT_DELAY);
+    }
+}
+
+// The timerfd is relative, so it works from whatever the injected clock says
+void ElevatorHost::armTimer() {
+    Clock::time_point due = timers.empty() ? nextHeartbeat : std::min(timers.top().at, nextHeartbeat);
+    auto left = std::chrono::duration_cast<std::chrono::nanoseconds>(due - clock.now()).count();
+    if (left < 1) left = 1; // Zero would disarm the timer
+    struct itimerspec spec = {};
+    spec.it_value.tv_sec = left / 1000000000;
+    spec.it_value.tv_nsec = left % 1000000000;
+    timerfd_settime(timerfd, 0, &spec, nullptr);
+}
+
+void ElevatorHost::queueReport(const char* msg, size_t len) {
+    outbox.emplace_back(msg, len);
+}
+
+void ElevatorHost::flushReports() {
+    // Through the scheduler's ring if it has one; what does not fit goes by UDP
+    if (schedulerRing) {
+        size_t kept = 0;
+        bool doorbell = false;
+        for (std::string& msg : outbox) {
+            if (schedulerRing->push(msg.data(), msg.size())) {
+                doorbell = doorbell || schedulerRing->takeDoorbell();
+            } else {
+                outbox[kept++] = std::move(msg);
+            }
+        }
+        outbox.resize(kept);
+        if (doorbell) outbox.emplace_back();
+    }
+
+    struct mmsghdr msgs[HOST_SEND_BATCH];
+    struct iovec iovs[HOST_SEND_BATCH];
+    size_t next = 0;
+    while (next < outbox.size()) {
+        int count = (int)std::min<size_t>(HOST_SEND_BATCH, outbox.size() - next);
+        for (int i = 0; i < count; ++i) {
+            std::string& msg = outbox[next + i];
+            iovs[i] = {&msg[0], msg.size()};
+            msgs[i] = {};
+            msgs[i].msg_hdr.msg_name = &schedulerAddr;
+            msgs[i].msg_hdr.msg_namelen = sizeof(schedulerAddr);
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        int sent = sendmmsg(sockfd, msgs, count, 0);
+        if (sent <= 0) break; // Dropped, as a failed sendto would be
+        next += sent;
+    }
+    outbox.clear();
+}
+
+HostedElevator* ElevatorHost::car(int id) {
+    if (id < firstID || id >= firstID + (int)cars.size()) return nullptr;
+    return cars[id - firstID].get();
+}
+
+void ElevatorHost::setBinary(bool enabled) {
+    for (auto& car : cars) car->setBinary(enabled);
+}
+
+void ElevatorHost::setSharedMemory(bool enabled) {
+    sharedMemory = enabled;
+}
+
+void ElevatorHost::setScheduler(const struct sockaddr_in& addr) {
+    schedulerAddr = addr;
+}
+
+void ElevatorHost::setPort(int commandPort) {
+    port = commandPort;
+}
+
+size_t ElevatorHost::pendingReports() const {
+    return outbox.size();
+}
+
+uint64_t ElevatorHost::getRejectedDatagrams() const {
+    return rejectedDatagrams;
+}
+
+#ifndef TEST_BUILD
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        std::cerr << "Usage: ./elevator_host <first id> <count> [--text] [--quiet] [--port <port>] [--shm]"
+                  << " [--scheduler <ip[:port]>]" << std::endl;
+        return 1;
+    }
+    int first = std::atoi(argv[1]);
+    int count = std::atoi(argv[2]);
+    bool text = false;
+    bool quiet = false;
+    int port = 0;
+    bool shm = false;
+    struct sockaddr_in scheduler;
+    parseEndpoint(SCHEDULER_IP, SCHEDULER_PORT, scheduler);
+    for (int i = 3; i < argc; ++i) {
+        if (strcmp(argv[i], "--text") == 0) text = true;
+        else if (strcmp(argv[i], "--quiet") == 0) quiet = true;
+        else if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) port = std::atoi(argv[++i]);
+        else if (strcmp(argv[i], "--shm") == 0) shm = true;
+        else if (strcmp(argv[i], "--scheduler") == 0 && i + 1 < argc) {
+            if (!parseEndpoint(argv[++i], SCHEDULER_PORT, scheduler)) {
+                std::cerr << "--scheduler takes <ipv4>[:<port>]" << std::endl;
+                return 1;
+            }
+        }
+    }
+    if (first < 1 || count < 1) {
+        std::cerr << "Elevator IDs start at 1 and the host needs at least one car" << std::endl;
+        return 1;
+    }
+
+    ElevatorHost host(first, count);
+    host.setBinary(!text);
+    host.setPort(port);
+    host.setSharedMemory(shm);
+    host.setScheduler(scheduler);
+    if (quiet) {
+        std::cout.rdbuf(nullptr); // Per-floor output from hundreds of cars
+        std::cerr.rdbuf(nullptr);
+    }
+    Elevator::stopOnSignals();
+    host.start();
+    return 0;
+}
+#endif
@@ -0,0 +1,126 @@
+#ifndef ELEVATOR_HOST_H
+#define ELEVATOR_HOST_H
+
+#include <deque>
+#include <memory>
+#include <queue>
+#include <string>
+#include <vector>
+#include "car_task.h"
+#include "clock.h"
+#include "elevator.h"
+
+#define HOST_RECV_BATCH 64 // Commands read per recvmmsg call
+#define HOST_SEND_BATCH 64 // Reports written per sendmmsg call
+#define HOST_EVENTS 2      // The socket and the timer
+
+class ElevatorHost;
+
+// Elevator whose main loop is a coroutine: the same straight-line code as
+// Elevator::runEventLoop(), but each sleep and each wait for a
+// command suspends the coroutine instead of blocking, so one thread can run
+// thousands of cars, each costing one small heap frame
+class HostedElevator : public Elevator {
+public:
+    HostedElevator(ElevatorHost& host, int id, Clock& clock);
+
+    void deliver(const std::string& cmd); // A command addressed to this car was received
+    void wake();                          // The delay the car was waiting out is over
+    void heartbeat();                     // Sends a HEARTBEAT if the car is idle
+    void leave();                         // Sends BYE unless the car already stopped after a hard fault
+
+protected:
+    void transmit(const char* msg, size_t len) override; // Queued on the host's outbox
+
+private:
+    // co_await sleep(d): resumed by the host's timer once 'd' has passed
+    struct Sleep {
+        HostedElevator& car;
+        Clock::duration delay;
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> h);
+        void await_resume() const noexcept {}
+    };
+    // co_await nextCommand(): the oldest undelivered command, waiting for one if need be
+    struct NextCommand {
+        HostedElevator& car;
+        bool await_ready() const noexcept { return !car.inbox.empty(); }
+        void await_suspend(std::coroutine_handle<> h);
+        std::string await_resume();
+    };
+
+    CarTask run();         // The car's whole life: commands, trips and STATUS reports
+    Sleep sleep(int seconds);
+    NextCommand nextCommand();
+
+    ElevatorHost& host;
+    std::deque<std::string> inbox;  // Commands not yet taken by nextCommand()
+    std::coroutine_handle<> resume; // Where run() is suspended
+    bool awaitingCommand = false;   // Suspended in nextCommand() rather than sleep()
+    CarTask task;
+};
+
+// Runs cars <first>..<first + count - 1> in one process on one thread. Every
+// car registers with the same port in its HELLO, so one socket takes all their
+// commands, which are handed to the car their elevator ID names, and carries
+// all their reports. Motion and heartbeats run on a single timerfd armed for
+// whatever is due first. Built with -std=c++20 for the coroutines.
+class ElevatorHost {
+public:
+    ElevatorHost(int firstID, int count, Clock& clock = Clock::real());
+    ~ElevatorHost();
+
+    void start(); // Binds the port, registers every car and serves until a stop signal, then says BYE
+
+    // Single-threaded entry points of the event loop, public for unit testing
+    void deliver(const char* data, size_t len);      // Hands a command to the car it names
+    void wakeAfter(int id, Clock::duration delay);   // Wakes the car once 'delay' has passed
+    void runDueTimers();                             // Wakes every car whose time has come
+    void queueReport(const char* msg, size_t len);   // Adds a report to the outbox
+
+    HostedElevator* car(int id); // nullptr if this host does not run that car
+    void setBinary(bool enabled);
+    void setPort(int commandPort); // Before start(); 0, the default, binds any free port
+    void setSharedMemory(bool enabled); // Before start(); trade messages through rings with a scheduler on this host
+    void setScheduler(const struct sockaddr_in& addr); // Before start(); SCHEDULER_IP:SCHEDULER_PORT by default
+    size_t pendingReports() const;
+    uint64_t getRejectedDatagrams() const;
+
+private:
+    // A car's next wakeup; each car has at most one pending
+    struct Timer {
+        Clock::time_point at;
+        uint64_t seq;
+        int id;
+    };
+    struct Later {
+        bool operator()(const Timer& a, const Timer& b) const {
+            return a.at != b.at ? a.at > b.at : a.seq > b.seq;
+        }
+    };
+
+    void openSocket();         // Binds the port every car is reached at
+    void runEventLoop();       // Waits on the socket and the timer, then flushes reports
+    void drainSocket();        // Delivers every command waiting on the socket
+    void armTimer();           // Points the timerfd at the earliest pending wakeup
+    void flushReports();       // Sends the outbox, HOST_SEND_BATCH at a time
+
+    int firstID;
+    Clock& clock;
+    std::vector<std::unique_ptr<HostedElevator>> cars; // Indexed by ID - firstID
+    int port = 0;
+    struct sockaddr_in schedulerAddr; // Where every report goes
+    int sockfd = -1;           // Every command comes in and every report goes out here
+    int epfd = -1;
+    int timerfd = -1;
+    std::priority_queue<Timer, std::vector<Timer>, Later> timers;
+    uint64_t timerSeq = 0;
+    Clock::time_point nextHeartbeat; // Next round of heartbeats from idle cars
+    std::vector<std::string> outbox; // Reports not yet flushed, in send order
+    uint64_t rejectedDatagrams = 0;  // Commands naming a car this host does not run
+    bool sharedMemory = false;
+    std::unique_ptr<ShmRing> commandRing;   // Named after the port; commands for every car
+    std::unique_ptr<ShmRing> schedulerRing; // Reports go here when the scheduler has one
+};
+
+#endif // ELEVATOR_HOST_H
@@ -0,0 +1,69 @@
+#define TEST_BUILD
+#include <gtest/gtest.h>
+#include "elevator_host.h"
+
+// Runs the host's timers on a virtual clock, one second at a time
+static void runFor(ElevatorHost& host, VirtualClock& clock, int seconds) {
+    for (int i = 0; i < seconds; ++i) {
+        clock.sleepFor(std::chrono::seconds(1));
+        host.runDueTimers();
+    }
+}
+
+TEST(ElevatorHostTest, DemultiplexesCommandsByElevatorID) {
+    VirtualClock clock;
+    ElevatorHost host(3, 2, clock);
+    testing::internal::CaptureStdout();
+    host.deliver("ROUTE 4 0 2", 11);
+    host.deliver("ROUTE 9 0 2", 11); // Not one of this host's cars
+    host.deliver("STATUS 3 0", 10);
+    runFor(host, clock, 10);
+    testing::internal::GetCapturedStdout();
+
+    EXPECT_EQ(host.car(3)->getCurrentFloor(), 0);
+    EXPECT_EQ(host.car(4)->getCurrentFloor(), 2);
+    EXPECT_EQ(host.car(9), nullptr);
+    EXPECT_EQ(host.getRejectedDatagrams(), 2u);
+}
+
+TEST(ElevatorHostTest, RunsBinaryRoutesOnOneTimer) {
+    VirtualClock clock;
+    ElevatorHost host(1, 2, clock);
+    testing::internal::CaptureStdout();
+    for (int id = 1; id <= 2; ++id) {
+        char msg[32];
+        size_t len = putWire(msg, 0, wireHeader(MsgType::ROUTE, id, 1, clock.now(), 0, 1));
+        len = putWire(msg, len, (uint32_t)0);
+        len = putWire(msg, len, (uint32_t)1); // Epoch
+        len = putWire(msg, len, (int16_t)(id * 3));
+        host.deliver(msg, len);
+    }
+    runFor(host, clock, 15);
+    testing::internal::GetCapturedStdout();
+
+    EXPECT_EQ(host.car(1)->getCurrentFloor(), 3);
+    EXPECT_EQ(host.car(2)->getCurrentFloor(), 6);
+    EXPECT_TRUE(host.car(2)->getItinerary().empty());
+    // An ACK for each route, a POSITION per floor, then an ARRIVED and a STATUS from each car
+    EXPECT_EQ(host.pendingReports(), 15u);
+}
+
+TEST(ElevatorHostTest, AppliesRouteUpdatesMidTrip) {
+    VirtualClock clock;
+    ElevatorHost host(1, 1, clock);
+    testing::internal::CaptureStdout();
+    host.deliver("ROUTE 1 0 4", 11);
+    runFor(host, clock, 3); // Suspended mid-trip; the update applies at once
+    host.deliver("ROUTE 1 0 4 1", 13);
+    EXPECT_EQ(host.car(1)->getItinerary(), std::deque<int>({4, 1}));
+    runFor(host, clock, 20);
+    testing::internal::GetCapturedStdout();
+
+    EXPECT_EQ(host.car(1)->getCurrentFloor(), 1);
+    EXPECT_TRUE(host.car(1)->getItinerary().empty());
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
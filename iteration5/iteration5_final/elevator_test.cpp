@@ -1,20 +1,28 @@
 #define TEST_BUILD
 #include <gtest/gtest.h>
 #include <iostream>
+#include <vector>
 #include "elevator.h"
 
 class MockElevator : public Elevator {
 public:
-    explicit MockElevator(int id) : Elevator(id) {}
+    explicit MockElevator(int id, Clock& clock = Clock::real()) : Elevator(id, clock) {}
     void sendStatus() override {
         std::cout << "[MOCK] Elevator " << getID() << " at floor " << getCurrentFloor() << std::endl;
     }
-    void receiveCommand() override {
-        std::cout << "[MOCK] Elevator " << getID() << " received command." << std::endl;
-        moveTo(2);
-    }
 };
 
+// Serves the itinerary the way the event loop does, one STEP_DELAY per step
+static void serveItinerary(Elevator& elevator, Clock& clock) {
+    while (elevator.beginNextStop()) {
+        do {
+            clock.sleepFor(std::chrono::seconds(STEP_DELAY));
+        } while (elevator.step());
+        if (elevator.isStuck()) return;
+        elevator.completeStop();
+    }
+}
+
 TEST(ElevatorTest, InitializesCorrectly) {
     MockElevator elevator(1);
     EXPECT_EQ(elevator.getCurrentFloor(), 0);
@@ -29,14 +37,136 @@ TEST(ElevatorTest, SendsStatus) {
 }
 
 TEST(ElevatorTest, ReceivesCommandAndMoves) {
-    MockElevator elevator(2);
+    VirtualClock clock;
+    MockElevator elevator(2, clock);
     testing::internal::CaptureStdout();
-    elevator.receiveCommand();
+    ASSERT_TRUE(elevator.handleCommand("MOVE 2 2"));
+    serveItinerary(elevator, clock);
     std::string output = testing::internal::GetCapturedStdout();
-    EXPECT_NE(output.find("received command"), std::string::npos);
+    EXPECT_NE(output.find("Received move command to Floor 2"), std::string::npos);
     EXPECT_EQ(elevator.getCurrentFloor(), 2);
 }
 
+// Elevator on a virtual clock that records its per-stop reports
+class RouteElevator : public Elevator {
+public:
+    RouteElevator(int id, Clock& clock) : Elevator(id, clock) {}
+    std::vector<int> arrivals;
+    void sendArrival() override { arrivals.push_back(getCurrentFloor()); }
+    void sendStatus() override {}
+    void sendReport(MsgType, uint32_t) override {}
+    std::vector<std::string> transmitted; // ACKs
+    void transmit(const char* msg, size_t len) override { transmitted.emplace_back(msg, len); }
+};
+
+TEST(ElevatorTest, RunsRouteStopByStop) {
+    VirtualClock clock;
+    RouteElevator elevator(1, clock);
+    testing::internal::CaptureStdout();
+    EXPECT_FALSE(elevator.handleCommand("ROUTE 2 0 5"));
+    ASSERT_TRUE(elevator.handleCommand("ROUTE 1 0 3 6"));
+    serveItinerary(elevator, clock);
+
+    // The scheduler built this route before it saw the two stops above
+    ASSERT_TRUE(elevator.handleCommand("ROUTE 1 0 3 6 2"));
+    EXPECT_EQ(elevator.getItinerary(), std::deque<int>({2}));
+    serveItinerary(elevator, clock);
+    testing::internal::GetCapturedStdout();
+
+    EXPECT_EQ(elevator.arrivals, std::vector<int>({3, 6, 2}));
+    EXPECT_EQ(elevator.getCurrentFloor(), 2);
+}
+
+// Binary ROUTE from the scheduler with the given epoch, nothing seen yet
+static std::string wireRoute(int id, uint32_t seq, uint32_t epoch, std::initializer_list<int16_t> stops) {
+    char msg[64];
+    size_t len = putWire(msg, 0, wireHeader(MsgType::ROUTE, id, seq, Clock::time_point{}, 0, (uint8_t)stops.size()));
+    len = putWire(msg, len, (uint32_t)0);
+    len = putWire(msg, len, epoch);
+    for (int16_t stop : stops) len = putWire(msg, len, stop);
+    return std::string(msg, len);
+}
+
+TEST(ElevatorTest, AppliesBinaryRoute) {
+    VirtualClock clock;
+    RouteElevator elevator(1, clock);
+    std::string route = wireRoute(1, 1, 7, {4, 1, 7});
+    testing::internal::CaptureStdout();
+    EXPECT_FALSE(elevator.handleCommand(route.substr(0, route.size() - 1))); // Truncated
+    ASSERT_TRUE(elevator.handleCommand(route));
+    EXPECT_EQ(elevator.getItinerary(), std::deque<int>({4, 1, 7}));
+
+    // A late copy of a route already applied is acknowledged again but ignored
+    EXPECT_FALSE(elevator.handleCommand(wireRoute(1, 1, 7, {2})));
+    EXPECT_EQ(elevator.getItinerary(), std::deque<int>({4, 1, 7}));
+    ASSERT_EQ(elevator.transmitted.size(), 2u);
+    Report ack;
+    ASSERT_TRUE(decodeReport(elevator.transmitted[1].data(), elevator.transmitted[1].size(), ack));
+    EXPECT_EQ(ack.type, MsgType::ACK);
+    EXPECT_EQ(ack.ackedSeq, 1u);
+
+    // A restarted scheduler has a new epoch; its routes apply whatever their seq
+    ASSERT_TRUE(elevator.handleCommand(wireRoute(1, 1, 8, {5})));
+    EXPECT_EQ(elevator.getItinerary(), std::deque<int>({5}));
+    EXPECT_FALSE(elevator.handleCommand(wireRoute(1, 1, 8, {6})));
+    ASSERT_TRUE(elevator.handleCommand(wireRoute(1, 2, 8, {6})));
+    testing::internal::GetCapturedStdout();
+    EXPECT_EQ(elevator.getItinerary(), std::deque<int>({6}));
+}
+
+TEST(ElevatorTest, FallsBackToTextOnlyForAnotherVersion) {
+    VirtualClock clock;
+    RouteElevator elevator(1, clock);
+    auto speaksBinary = [&] {
+        elevator.sendHello();
+        return isWireMessage(elevator.transmitted.back().data(), elevator.transmitted.back().size());
+    };
+    testing::internal::CaptureStdout();
+    // Truncated, garbled or addressed elsewhere: dropped, the car stays binary
+    std::string route = wireRoute(1, 1, 7, {4});
+    EXPECT_FALSE(elevator.handleCommand(route.substr(0, route.size() - 1)));
+    std::string garbled = route.substr(0, 4) + std::string(16, 'x'); // Claims 'x' stops
+    garbled[3] = 'x';
+    EXPECT_FALSE(elevator.handleCommand(garbled));
+    std::string other = wireRoute(2, 1, 7, {4});
+    other[1] = WIRE_VERSION + 1;
+    EXPECT_FALSE(elevator.handleCommand(other));
+    EXPECT_TRUE(speaksBinary());
+
+    // A scheduler on another version gets text until a route of this version comes
+    route[1] = WIRE_VERSION + 1;
+    EXPECT_FALSE(elevator.handleCommand(route));
+    EXPECT_FALSE(speaksBinary());
+    route[1] = WIRE_VERSION;
+    ASSERT_TRUE(elevator.handleCommand(route));
+    testing::internal::GetCapturedStdout();
+    EXPECT_TRUE(speaksBinary());
+}
+
+TEST(ElevatorTest, RetargetsMidTrip) {
+    VirtualClock clock;
+    RouteElevator elevator(1, clock);
+    testing::internal::CaptureStdout();
+    ASSERT_TRUE(elevator.handleCommand("ROUTE 1 0 6"));
+    ASSERT_TRUE(elevator.beginNextStop());
+    while (elevator.getCurrentFloor() < 2) ASSERT_TRUE(elevator.step());
+
+    // Floor 3 is still ahead, so the car stops there first
+    ASSERT_TRUE(elevator.handleCommand("ROUTE 1 0 3 6"));
+    while (elevator.getCurrentFloor() < 3) ASSERT_TRUE(elevator.step());
+    ASSERT_TRUE(elevator.step()); // Doors opening at 3
+
+    // Too late to skip floor 3: it stays first and is not visited twice
+    ASSERT_TRUE(elevator.handleCommand("ROUTE 1 0 5 3 6"));
+    EXPECT_EQ(elevator.getItinerary(), std::deque<int>({3, 5, 6}));
+    EXPECT_FALSE(elevator.step());
+    elevator.completeStop();
+    testing::internal::GetCapturedStdout();
+
+    EXPECT_EQ(elevator.arrivals, std::vector<int>({3}));
+    EXPECT_EQ(elevator.getItinerary(), std::deque<int>({5, 6}));
+}
+
 int main(int argc, char **argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
@@ -0,0 +1,145 @@
+#ifndef FLEET_H
+#define FLEET_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+#include "clock.h"
+#include "wire.h"
+
+#define CACHE_LINE 64
+
+// Elevator state as seen by the scheduler; OK and REACHED cars can be dispatched.
+// The dispatch kernels read these as int32 and rely on OK = 0 and REACHED = 1.
+// OFFLINE marks a slot with no car registered in it.
+enum class ElevatorState : int32_t { OK, REACHED, MOVING, WARNING, FAULT, OFFLINE };
+static_assert(sizeof(ElevatorState) == sizeof(int32_t), "status column is scanned as int32");
+
+// Sweep direction of a car under collective control
+enum class Direction : int32_t { IDLE, UP, DOWN };
+
+inline bool isAvailable(ElevatorState state) {
+    return state == ElevatorState::OK || state == ElevatorState::REACHED;
+}
+
+// Display text, e.g. "REACHED" or "WARNING(DOOR_STUCK)"; only used when printing
+inline std::string statusText(ElevatorState state, uint32_t warnings) {
+    switch (state) {
+    case ElevatorState::OK: return "OK";
+    case ElevatorState::REACHED: return "REACHED";
+    case ElevatorState::MOVING: return "MOVING";
+    case ElevatorState::FAULT: return "FAULT";
+    case ElevatorState::OFFLINE: return "OFFLINE";
+    case ElevatorState::WARNING: break;
+    }
+    std::string text = "WARNING(";
+    if (warnings & WARN_DOOR_STUCK) text += "DOOR_STUCK|";
+    if (warnings & WARN_UNKNOWN) text += "UNKNOWN|";
+    if (text.back() == '|') text.pop_back();
+    return text + ")";
+}
+
+// One car's columns as the display thread sees them, copied out of the table
+struct CarView {
+    int32_t floor;
+    int32_t load;
+    ElevatorState status;
+    uint32_t warnings;
+};
+
+// Allocator that starts every array on its own cache line
+template <typename T>
+struct AlignedAllocator {
+    using value_type = T;
+
+    AlignedAllocator() = default;
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U>&) {}
+
+    T* allocate(std::size_t n) {
+        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(CACHE_LINE)));
+    }
+    void deallocate(T* p, std::size_t) {
+        ::operator delete(p, std::align_val_t(CACHE_LINE));
+    }
+
+    template <typename U>
+    bool operator==(const AlignedAllocator<U>&) const { return true; }
+    template <typename U>
+    bool operator!=(const AlignedAllocator<U>&) const { return false; }
+};
+
+template <typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
+// Per-elevator state kept as a struct of arrays. Elevator 'id' lives at slot
+// id - 1 of every column, so the dispatch scan walks a few contiguous arrays
+// instead of hashing per car. IDs not in use inside 1..size() are OFFLINE.
+struct FleetTable {
+    AlignedVector<int32_t> floor;                 // Last floor the car reported
+    AlignedVector<int32_t> load;                  // Passengers assigned and not yet delivered
+    AlignedVector<ElevatorState> status;          // OK, REACHED, MOVING, WARNING, FAULT or OFFLINE
+    AlignedVector<uint32_t> warnings;             // WarningFlag bits of the active warning
+    AlignedVector<Clock::time_point> warningTime; // Last WARNING, NEVER if none
+    AlignedVector<Clock::time_point> lastUpdate;  // Last message received from the car
+    AlignedVector<Direction> direction;           // Current sweep, IDLE when the car has no stops
+    AlignedVector<int32_t> legTarget;             // First stop of the car's route, NO_LEG if none
+    AlignedVector<int32_t> stopsDone;             // ARRIVED reports received from the car
+
+    static constexpr Clock::time_point NEVER = Clock::time_point::min();
+    static constexpr int32_t NO_LEG = INT32_MIN;
+
+    explicit FleetTable(int count = 0) { resize(count); }
+
+    // New elevators start at floor 0, empty and in state 'initial'
+    void resize(int count, ElevatorState initial = ElevatorState::OK) {
+        floor.resize(count, 0);
+        load.resize(count, 0);
+        status.resize(count, initial);
+        warnings.resize(count, WARN_NONE);
+        warningTime.resize(count, NEVER);
+        lastUpdate.resize(count, NEVER);
+        direction.resize(count, Direction::IDLE);
+        legTarget.resize(count, NO_LEG);
+        stopsDone.resize(count, 0);
+    }
+
+    int size() const { return static_cast<int>(floor.size()); }
+    bool contains(int id) const { return id >= 1 && id <= size(); }
+    bool isRegistered(int id) const { return contains(id) && status[slot(id)] != ElevatorState::OFFLINE; }
+    static int slot(int id) { return id - 1; }
+
+    // Puts a slot back as resize() creates it
+    void reset(int id, ElevatorState initial) {
+        int i = slot(id);
+        floor[i] = 0;
+        load[i] = 0;
+        status[i] = initial;
+        warnings[i] = WARN_NONE;
+        warningTime[i] = NEVER;
+        lastUpdate[i] = NEVER;
+        direction[i] = Direction::IDLE;
+        legTarget[i] = NO_LEG;
+        stopsDone[i] = 0;
+    }
+
+    int32_t& floorOf(int id) { return floor[slot(id)]; }
+    int32_t& loadOf(int id) { return load[slot(id)]; }
+    ElevatorState& statusOf(int id) { return status[slot(id)]; }
+    uint32_t& warningsOf(int id) { return warnings[slot(id)]; }
+    std::string statusTextOf(int id) const { return statusText(status[slot(id)], warnings[slot(id)]); }
+    Clock::time_point& warningTimeOf(int id) { return warningTime[slot(id)]; }
+    Clock::time_point& lastUpdateOf(int id) { return lastUpdate[slot(id)]; }
+    Direction& directionOf(int id) { return direction[slot(id)]; }
+    int32_t& legTargetOf(int id) { return legTarget[slot(id)]; }
+    int32_t& stopsDoneOf(int id) { return stopsDone[slot(id)]; }
+    CarView viewOf(int id) const {
+        int i = slot(id);
+        return {floor[i], load[i], status[i], warnings[i]};
+    }
+};
+
+#endif // FLEET_H
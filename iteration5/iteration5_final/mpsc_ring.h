@@ -0,0 +1,91 @@
+#ifndef MPSC_RING_H
+#define MPSC_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#ifndef CACHE_LINE
+#define CACHE_LINE 64
+#endif
+
+inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+// Bounded lock-free queue for any number of producers and one consumer.
+// Every cell carries a sequence number: a producer claims a slot by advancing
+// 'tail' with a CAS, fills the cell and then publishes it by bumping the
+// sequence; the consumer owns 'head' outright and never needs a CAS.
+template <typename T>
+class MpscRing {
+public:
+    // 'capacity' is rounded up to a power of two
+    explicit MpscRing(size_t capacity) : cells(roundUp(capacity)), mask(cells.size() - 1) {
+        for (size_t i = 0; i < cells.size(); ++i) cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    MpscRing(const MpscRing&) = delete;
+    MpscRing& operator=(const MpscRing&) = delete;
+
+    // Any thread; false if the ring is full
+    bool tryPush(T value) {
+        size_t pos = tail.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells[pos & mask];
+            size_t seq = cell.seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.value = std::move(value);
+                    cell.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false; // The consumer has not freed this cell yet
+            } else {
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Consumer thread only; false if nothing has been published
+    bool tryPop(T& out) {
+        Cell& cell = cells[head & mask];
+        if (cell.seq.load(std::memory_order_acquire) != head + 1) return false;
+        out = std::move(cell.value);
+        cell.seq.store(head + cells.size(), std::memory_order_release);
+        head++;
+        return true;
+    }
+
+    // Consumer thread only
+    bool empty() const {
+        return cells[head & mask].seq.load(std::memory_order_acquire) != head + 1;
+    }
+
+    size_t capacity() const { return cells.size(); }
+
+private:
+    struct alignas(CACHE_LINE) Cell {
+        std::atomic<size_t> seq;
+        T value;
+    };
+
+    static size_t roundUp(size_t n) {
+        size_t size = 1;
+        while (size < n) size <<= 1;
+        return size;
+    }
+
+    std::vector<Cell> cells;
+    const size_t mask;
+    alignas(CACHE_LINE) std::atomic<size_t> tail{0}; // Next slot a producer will claim
+    alignas(CACHE_LINE) size_t head = 0;             // Next slot the consumer reads
+};
+
+#endif // MPSC_RING_H
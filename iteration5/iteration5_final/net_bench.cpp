@@ -0,0 +1,171 @@
+// net_bench.cpp - Scheduler CPU and system calls per datagram with the epoll and io_uring backends under sustained load
+#include "scheduler.h"
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define BENCH_CARS 32           // Cars the load generator plays, all on its one socket
+#define BENCH_FLOORS 20
+#define BENCH_WARMUP_MS 300     // Load before the measurement starts
+#define BENCH_MEASURE_MS 2000
+#define BENCH_REQUEST_EVERY 20  // One datagram in this many is a hall call; the rest are heartbeats
+
+using SteadyClock = std::chrono::steady_clock;
+
+// Scheduler-side deltas over the measurement window
+struct Result {
+    double received;  // Datagrams per second
+    double sent;      // Commands per second
+    double cpuUs;     // Scheduler CPU time per datagram in or out
+    double syscalls;  // Per datagram in or out
+};
+
+static double cpuSeconds() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+static uint64_t syscallsOf(const StatsView& s) {
+    return s.uringEnters ? s.uringEnters : s.epollWaits + s.recvCalls + s.sendCalls;
+}
+
+// Child: a real scheduler on SCHEDULER_PORT, sampled at the window's edges
+static void runScheduler(bool uring, SteadyClock::time_point start, int resultFd) {
+    std::cout.rdbuf(nullptr);
+    Scheduler* scheduler = new Scheduler(0, BENCH_FLOORS); // Left to _exit()
+    scheduler->setTextOnly(true);
+    scheduler->setIoUring(uring);
+    std::thread([scheduler] { scheduler->start(); }).detach();
+
+    std::this_thread::sleep_until(start + std::chrono::milliseconds(BENCH_WARMUP_MS));
+    StatsView before = scheduler->statsView();
+    double cpuBefore = cpuSeconds();
+    std::this_thread::sleep_for(std::chrono::milliseconds(BENCH_MEASURE_MS));
+    StatsView after = scheduler->statsView();
+    double cpu = cpuSeconds() - cpuBefore;
+
+    double seconds = BENCH_MEASURE_MS / 1000.0;
+    double in = after.datagramsReceived - before.datagramsReceived;
+    double out = after.commandsSent - before.commandsSent;
+    Result r = {in / seconds, out / seconds, in + out > 0 ? cpu * 1e6 / (in + out) : 0,
+                in + out > 0 ? (syscallsOf(after) - syscallsOf(before)) / (in + out) : 0};
+    if (write(resultFd, &r, sizeof(r)) != (ssize_t)sizeof(r)) _exit(1);
+    _exit(0);
+}
+
+// An io_uring is torn down after its process exits, and the socket it held
+// with it, so the next run waits until SCHEDULER_PORT is free again
+static void waitForPort() {
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(SCHEDULER_PORT);
+    for (int tries = 0; tries < 100; ++tries) {
+        int sock = socket(AF_INET, SOCK_DGRAM, 0);
+        bool free = bind(sock, (struct sockaddr*)&addr, sizeof(addr)) == 0;
+        close(sock);
+        if (free) return;
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+}
+
+// Parent: every car registers, then heartbeats and hall calls go out at 'rate'
+// per second in 1 ms batches, and each route is served at once: an ARRIVED
+// per stop, then a STATUS
+static Result run(bool uring, int rate) {
+    waitForPort();
+    int fds[2];
+    if (pipe(fds) < 0) exit(EXIT_FAILURE);
+    SteadyClock::time_point start = SteadyClock::now() + std::chrono::milliseconds(200);
+    pid_t child = fork();
+    if (child == 0) runScheduler(uring, start, fds[1]);
+    close(fds[1]);
+
+    int sock = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    struct sockaddr_in self = {};
+    self.sin_family = AF_INET;
+    self.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t selfLen = sizeof(self);
+    bind(sock, (struct sockaddr*)&self, sizeof(self));
+    getsockname(sock, (struct sockaddr*)&self, &selfLen);
+    struct sockaddr_in scheduler = {};
+    scheduler.sin_family = AF_INET;
+    scheduler.sin_port = htons(SCHEDULER_PORT);
+    scheduler.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    auto send = [&](const std::string& msg) {
+        sendto(sock, msg.data(), msg.size(), 0, (struct sockaddr*)&scheduler, sizeof(scheduler));
+    };
+
+    std::this_thread::sleep_until(start - std::chrono::milliseconds(100)); // The scheduler is listening
+    std::vector<int> floors(BENCH_CARS + 1, 0);
+    std::vector<int> arrivals(BENCH_CARS + 1, 0);
+    for (int id = 1; id <= BENCH_CARS; ++id) {
+        send("HELLO " + std::to_string(id) + " 0 127.0.0.1 " + std::to_string(ntohs(self.sin_port)) + " 0");
+    }
+
+    std::this_thread::sleep_until(start);
+    SteadyClock::time_point end = start + std::chrono::milliseconds(BENCH_WARMUP_MS + BENCH_MEASURE_MS);
+    int perMs = std::max(1, rate / 1000);
+    uint64_t count = 0;
+    char buffer[BUFFER_SIZE];
+    for (auto tick = start; tick < end; tick += std::chrono::milliseconds(1)) {
+        std::this_thread::sleep_until(tick);
+        for (int i = 0; i < perMs; ++i, ++count) {
+            int id = (int)(count % BENCH_CARS) + 1;
+            if (count % BENCH_REQUEST_EVERY == 0) {
+                int from = (int)(count / BENCH_REQUEST_EVERY % BENCH_FLOORS);
+                int to = (from + 7) % BENCH_FLOORS;
+                send(std::to_string(from) + (to > from ? " UP " : " DOWN ") + std::to_string(to));
+            } else {
+                send("HEARTBEAT " + std::to_string(id) + " " + std::to_string(floors[id]));
+            }
+        }
+        ssize_t n;
+        while ((n = recv(sock, buffer, sizeof(buffer) - 1, 0)) > 0) {
+            buffer[n] = '\0';
+            std::istringstream route(buffer); // "ROUTE <id> <seen> <floor>..."
+            std::string type;
+            int id, seen, floor;
+            if (!(route >> type >> id >> seen) || id < 1 || id > BENCH_CARS) continue;
+            for (int skip = arrivals[id] - seen; route >> floor;) {
+                if (skip-- > 0) continue; // Made since the scheduler built the route
+                floors[id] = floor;
+                arrivals[id]++;
+                send("ARRIVED " + std::to_string(id) + " " + std::to_string(floor));
+            }
+            send("STATUS " + std::to_string(id) + " " + std::to_string(floors[id]));
+        }
+    }
+
+    Result r = {};
+    if (read(fds[0], &r, sizeof(r)) != (ssize_t)sizeof(r)) std::cerr << "No result from the scheduler\n";
+    waitpid(child, nullptr, 0);
+    close(fds[0]);
+    close(sock);
+    return r;
+}
+
+int main() {
+    std::cout << "Hardware threads: " << std::thread::hardware_concurrency() << "\n\n";
+    std::cout << "| Offered/s | Backend  | Received/s | Commands/s | CPU us/datagram | Syscalls/datagram |\n";
+    std::cout << "|-----------|----------|------------|------------|-----------------|-------------------|\n";
+    for (int rate : {10000, 50000, 100000}) {
+        for (bool uring : {false, true}) {
+            Result r = run(uring, rate);
+            std::cout << "| " << std::setw(9) << rate << " | " << std::setw(8) << (uring ? "io_uring" : "epoll")
+                      << " | " << std::fixed << std::setprecision(0) << std::setw(10) << r.received << " | "
+                      << std::setw(10) << r.sent << " | " << std::setprecision(2) << std::setw(15) << r.cpuUs
+                      << " | " << std::setprecision(3) << std::setw(17) << r.syscalls << " |\n";
+        }
+    }
+    return 0;
+}
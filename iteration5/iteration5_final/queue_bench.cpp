@@ -0,0 +1,132 @@
+// queue_bench.cpp - Handoff latency between threads of a mutex queue and the lock-free ring at peak request rates
+#include "mpsc_ring.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#define BENCH_SECONDS 0.5   // Length of each run
+#define BENCH_RING_SIZE 4096
+
+using SteadyClock = std::chrono::steady_clock;
+
+// Latency percentiles of one run, in microseconds
+struct Result {
+    double p50;
+    double p99;
+    double max;
+    uint64_t wakeups; // Times the consumer read the eventfd
+};
+
+// The usual alternative: deque, mutex and condition variable
+class MutexQueue {
+public:
+    void push(SteadyClock::time_point sent) {
+        std::lock_guard<std::mutex> lock(mutex);
+        items.push_back(sent);
+        cv.notify_one();
+    }
+    SteadyClock::time_point pop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [this] { return !items.empty(); });
+        SteadyClock::time_point sent = items.front();
+        items.pop_front();
+        return sent;
+    }
+
+private:
+    std::deque<SteadyClock::time_point> items;
+    std::mutex mutex;
+    std::condition_variable cv;
+};
+
+// Ring plus an eventfd, as one scheduler shard hands datagrams to another.
+// The consumer reads the eventfd only when the ring is empty, sleeping in the
+// read until a producer writes to it.
+class RingQueue {
+public:
+    RingQueue() : efd(eventfd(0, EFD_CLOEXEC)) {}
+    ~RingQueue() { close(efd); }
+    void push(SteadyClock::time_point sent) {
+        while (!ring.tryPush(sent)) std::this_thread::yield();
+        uint64_t one = 1;
+        if (write(efd, &one, sizeof(one)) < 0) perror("eventfd write");
+    }
+    SteadyClock::time_point pop() {
+        SteadyClock::time_point sent;
+        while (!ring.tryPop(sent)) {
+            uint64_t count;
+            if (read(efd, &count, sizeof(count)) < 0) perror("eventfd read");
+            reads++;
+        }
+        return sent;
+    }
+    uint64_t wakeups() const { return reads; }
+
+private:
+    MpscRing<SteadyClock::time_point> ring{BENCH_RING_SIZE};
+    int efd;
+    uint64_t reads = 0;
+};
+
+static uint64_t wakeupsOf(const MutexQueue&) { return 0; }
+static uint64_t wakeupsOf(const RingQueue& queue) { return queue.wakeups(); }
+
+// 'producers' threads send 'rate' requests per second between them, evenly
+// paced; the consumer timestamps each one as it is taken off the queue
+template <typename Queue>
+static Result run(int producers, int rate) {
+    Queue queue;
+    int perProducer = std::max(1, (int)(rate * BENCH_SECONDS) / producers);
+    auto interval = std::chrono::nanoseconds(1000000000LL * producers / rate);
+    auto start = SteadyClock::now() + std::chrono::milliseconds(10);
+
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; ++p) {
+        threads.emplace_back([&queue, perProducer, interval, start, p, producers] {
+            auto next = start + interval * p / producers;
+            for (int i = 0; i < perProducer; ++i, next += interval) {
+                std::this_thread::sleep_until(next);
+                queue.push(SteadyClock::now());
+            }
+        });
+    }
+
+    std::vector<double> latency;
+    latency.reserve(perProducer * producers);
+    for (int i = 0; i < perProducer * producers; ++i) {
+        SteadyClock::time_point sent = queue.pop();
+        latency.push_back(std::chrono::duration<double, std::micro>(SteadyClock::now() - sent).count());
+    }
+    for (std::thread& t : threads) t.join();
+
+    std::sort(latency.begin(), latency.end());
+    return {latency[latency.size() / 2], latency[latency.size() * 99 / 100], latency.back(), wakeupsOf(queue)};
+}
+
+int main() {
+    std::cout << "Hardware threads: " << std::thread::hardware_concurrency() << "\n\n";
+    std::cout << "| Producers | Rate (req/s) | Mutex p50 us | Mutex p99 us | Ring p50 us | Ring p99 us | Ring max us | Ring reads/req |\n";
+    std::cout << "|-----------|--------------|--------------|--------------|-------------|-------------|-------------|----------------|\n";
+    for (int producers : {1, 4}) {
+        for (int rate : {1000, 10000, 100000}) {
+            Result mutex = run<MutexQueue>(producers, rate);
+            Result ring = run<RingQueue>(producers, rate);
+            double requests = (int)(rate * BENCH_SECONDS) / producers * producers;
+            std::cout << "| " << std::setw(9) << producers << " | " << std::setw(12) << rate << " | "
+                      << std::fixed << std::setprecision(1) << std::setw(12) << mutex.p50 << " | "
+                      << std::setw(12) << mutex.p99 << " | " << std::setw(11) << ring.p50 << " | "
+                      << std::setw(11) << ring.p99 << " | " << std::setw(11) << ring.max << " | "
+                      << std::setprecision(3) << std::setw(14) << ring.wakeups / requests << " |\n";
+        }
+    }
+    return 0;
+}
@@ -1,244 +1,1553 @@
 // scheduler.cpp - Iteration 5 Final with MOVING/REACHED UI and All Fixes
+#include "scheduler.h"
+#include "text_parser.h"
 #include <iostream>
-#include <unordered_map>
-#include <queue>
-#include <string>
+#include <cstdio>
+#include <cstring>
 #include <thread>
-#include <mutex>
-#include <condition_variable>
-#include <netinet/in.h>
+#include <cstddef>
 #include <arpa/inet.h>
+#include <linux/filter.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
 #include <unistd.h>
-#include <sstream>
-#include <climits>
-#include <chrono>
 #include <iomanip>
 #include <vector>
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <iterator>
+#include <random>
+#include <set>
+
+Scheduler::Scheduler(int elevCount, int floorMax, Clock& clock)
+    : clock(clock), wheelEpoch(clock.now()), rto(std::chrono::milliseconds(ROUTE_RTO_INITIAL_MS)),
+      floorCount(floorMax) {
+    // Cars keep no replay state across schedulers: a ROUTE from another epoch
+    // is applied whatever its sequence number
+    schedulerEpoch = std::random_device{}();
+    idleCars.setFloors(floorCount);
+    for (int id = 1; id <= elevCount; ++id) registerElevator(id, defaultAddress(id), CAP_ROUTE_ACK);
+    startTime = clock.now();
+}
+
+Scheduler::~Scheduler() {
+    if (sockfd >= 0) close(sockfd);
+    if (forwardFd >= 0) close(forwardFd);
+}
+
+// Cars that never send HELLO listen on BASE_PORT + their ID on this host
+struct sockaddr_in Scheduler::defaultAddress(int id) {
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(BASE_PORT + id);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    return addr;
+}
+
+// Create the UDP socket and bind it to the scheduler port. Shards share the
+// port; the kernel numbers their sockets in the order they bind.
+void Scheduler::openSocket() {
+    if (sockfd >= 0) return;
+    sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sockfd < 0) {
+        perror("[Scheduler] Socket creation failed");
+        exit(EXIT_FAILURE);
+    }
+    if (shards.size() > 1) {
+        int on = 1;
+        setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+    }
+    selfAddr = {AF_INET, htons(SCHEDULER_PORT), INADDR_ANY};
+    if (bind(sockfd, (struct sockaddr*)&selfAddr, sizeof(selfAddr)) < 0) {
+        perror("[Scheduler] Bind failed");
+        exit(EXIT_FAILURE);
+    }
+    std::cout << "[Scheduler] Listening on port " << SCHEDULER_PORT;
+    if (shards.size() > 1) std::cout << " (shard " << shardIndex + 1 << " of " << shards.size() << ")";
+    std::cout << std::endl;
+    if (shards.size() > 1 && shardIndex == 0) attachSteering();
+    if (sharedMemory && shardIndex == 0) {
+        // One ring for the group; its messages reach the other shards by forwarding
+        shmInbox = ShmRing::create(SCHEDULER_PORT);
+        if (!shmInbox) perror("[Scheduler] Shared-memory ring unavailable, using UDP only");
+    }
+}
+
+// Classic BPF run by the kernel on each datagram for the port, to pick the
+// socket, and so the shard, that gets it. It sees the UDP payload: a binary
+// message from a car goes to the shard owning the car's bank, and a binary
+// hall call to the shard numbered by its sequence number, which deals one
+// client's calls across every bank. Anything else gets an out-of-range index,
+// which makes the kernel fall back to its hash of the sender's address, and
+// a text message from a car is forwarded if that lands it on the wrong shard.
+void Scheduler::attachSteering() {
+    // Header fields are little-endian on the wire
+    const uint32_t idLow = offsetof(WireHeader, elevatorID);
+    const uint32_t idHigh = offsetof(WireHeader, elevatorID) + 1;
+    const uint32_t seqLow = offsetof(WireHeader, seq);
+    const uint32_t groupSize = (uint32_t)shards.size();
+    struct sock_filter code[] = {
+        BPF_STMT(BPF_LD | BPF_W | BPF_LEN, 0),
+        BPF_JUMP(BPF_JMP | BPF_JGE | BPF_K, sizeof(WireHeader), 0, 15), // Too short to be binary
+        BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 0),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, WIRE_MAGIC, 0, 13),          // Text
+        BPF_STMT(BPF_LD | BPF_B | BPF_ABS, idHigh),
+        BPF_STMT(BPF_ALU | BPF_LSH | BPF_K, 8),
+        BPF_STMT(BPF_MISC | BPF_TAX, 0),
+        BPF_STMT(BPF_LD | BPF_B | BPF_ABS, idLow),
+        BPF_STMT(BPF_ALU | BPF_OR | BPF_X, 0),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0, 4, 0),                    // A hall call
+        BPF_STMT(BPF_ALU | BPF_SUB | BPF_K, 1),                           // shardOf()
+        BPF_STMT(BPF_ALU | BPF_DIV | BPF_K, (uint32_t)bankSize),
+        BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, groupSize),
+        BPF_STMT(BPF_RET | BPF_A, 0),
+        BPF_STMT(BPF_LD | BPF_B | BPF_ABS, seqLow),
+        BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, groupSize),
+        BPF_STMT(BPF_RET | BPF_A, 0),
+        BPF_STMT(BPF_RET | BPF_K, 0xffffffff),
+    };
+    struct sock_fprog program = {(unsigned short)(sizeof(code) / sizeof(code[0])), code};
+    if (setsockopt(sockfd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &program, sizeof(program)) < 0) {
+        perror("[Scheduler] Steering program refused, shards forward by hash only");
+    }
+}
 
-#define BUFFER_SIZE 1024
-#define BASE_PORT 5100
-#define SCHEDULER_PORT 5002
-#define MAX_CAPACITY 4
-// Structure to represent a client request
-struct Request {
-    int floor;
-    int targetFloor;
-    std::string direction;
-    Request(int f, int t, const std::string& d) : floor(f), targetFloor(t), direction(d) {}
-};
-
-// Main class that handles scheduling logic
-class Scheduler {
-private:
-    int sockfd;
-    struct sockaddr_in selfAddr;
-    // Elevator tracking
-    std::unordered_map<int, int> elevatorFloors;   // Current floor of each elevator
-    std::unordered_map<int, int> elevatorLoad;     // Current load of each elevator
-    std::unordered_map<int, std::string> elevatorStatus; // Status (OK, MOVING, REACHED, etc.)
-
-    std::queue<Request> requestQueue;  // Queue of pending client requests
-    std::mutex queueMutex;             // Mutex for request queue
-    std::condition_variable cv;        // Condition variable for queue processing
-
-    std::chrono::steady_clock::time_point startTime; // Simulation start time
-    std::unordered_map<int, std::chrono::steady_clock::time_point> warningTimestamps; // Last warning time for elevators
-
-    int moveCount = 0; // Number of move commands sent
-    int requestsHandled = 0; //Numbver of requests handled
-    int elevatorCount; // Number of elevators
-    int floorCount; // Number of floors
-
-public:
-    Scheduler(int elevCount, int floorMax) : elevatorCount(elevCount), floorCount(floorMax) {
-        //Create UDP socket
-        sockfd = socket(AF_INET, SOCK_DGRAM, 0);
-        if (sockfd < 0) {
-            perror("[Scheduler] Socket creation failed");
-            exit(EXIT_FAILURE);
-        }
-        //Bind socket to scheduler port
-        selfAddr = {AF_INET, htons(SCHEDULER_PORT), INADDR_ANY};
-        if (bind(sockfd, (struct sockaddr*)&selfAddr, sizeof(selfAddr)) < 0) {
-            perror("[Scheduler] Bind failed");
-            exit(EXIT_FAILURE);
-        }
-        // Initialize elevators to floor 0, load 0, and status OK
-        for (int i = 1; i <= elevatorCount; ++i) {
-            elevatorFloors[i] = 0;
-            elevatorLoad[i] = 0;
-            elevatorStatus[i] = "OK";
-        }
-
-        std::cout << "[Scheduler] Listening on port " << SCHEDULER_PORT << std::endl;
-    }
-
-    ~Scheduler() { close(sockfd); }
-
-    void start();
-
-private:
-    void receiveMessages();                    // Receives messages from elevators and clients
-    void handleClientRequest(std::stringstream& ss, const std::string& firstToken); // Parses and enqueues client requests
-    void processRequests();                    // Assigns requests to elevators
-    int findBestElevator(const Request& req);  // Selects best elevator for a request
-    void sendMoveCommand(int elevatorID, int targetFloor); // Sends move command to elevator
-    void displayStatusLoop();                 // Periodically displays status of elevators
-};
-
-// Main control function: starts threads
+void Scheduler::shard(const std::vector<Scheduler*>& group, int bankSize) {
+    for (size_t i = 0; i < group.size(); ++i) {
+        Scheduler* member = group[i];
+        member->shards = group;
+        member->shardIndex = (int)i;
+        member->bankSize = std::max(1, bankSize);
+        if (group.size() > 1 && !member->forwardRing) {
+            member->forwardRing.reset(new MpscRing<ForwardedDatagram>(SHARD_FORWARD_RING));
+            member->forwardFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        }
+    }
+}
+
+int Scheduler::shardOf(int id) const {
+    return (id - 1) / bankSize % (int)shards.size();
+}
+
+bool Scheduler::ownsElevator(int id) const {
+    return id < 1 || shardOf(id) == shardIndex; // Nobody owns a bad ID; it is rejected where it lands
+}
+
+// Main control function: the display runs on its own thread, everything else
+// on the event loop. The io_uring is made here, on the thread that drives it,
+// since it is set up for one issuer. Of a group only the first shard displays,
+// for all of them.
 void Scheduler::start() {
-    startTime = std::chrono::steady_clock::now();
-    std::thread(&Scheduler::receiveMessages, this).detach();
-    std::thread(&Scheduler::processRequests, this).detach();
-    std::thread(&Scheduler::displayStatusLoop, this).join();
+    openSocket();
+    if (ioUring) {
+        uring = UringSocket::create(sockfd);
+        if (!uring) perror("[Scheduler] io_uring unavailable, using epoll");
+        else if (forwardFd >= 0) uring->watch(forwardFd);
+    }
+    startTime = clock.now();
+    if (shardIndex == 0) std::thread(&Scheduler::displayStatusLoop, this).detach();
+    runEventLoop();
 }
 
-// Receives UDP messages from elevators and clients
-void Scheduler::receiveMessages() {
-    char buffer[BUFFER_SIZE];
-    struct sockaddr_in senderAddr;
-    socklen_t len = sizeof(senderAddr);
+// Single-threaded reactor: waits on the socket with epoll, or io_uring if it
+// is set up, applies every datagram that is waiting and then dispatches, all
+// on this thread, so the fleet table needs no lock. A shard also wakes for
+// datagrams the others forward. The only timed wakeups are a pending warning
+// expiry and the end of a batch window.
+void Scheduler::runEventLoop() {
+    int epfd = epoll_create1(0);
+    if (epfd < 0) {
+        perror("[Scheduler] epoll_create1 failed");
+        exit(EXIT_FAILURE);
+    }
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.fd = sockfd;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, sockfd, &ev);
+    if (forwardFd >= 0) {
+        ev.data.fd = forwardFd;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, forwardFd, &ev);
+    }
 
+    Clock::time_point batchDue = Clock::time_point::max(); // End of the open batch window
     while (true) {
-        int n = recvfrom(sockfd, buffer, BUFFER_SIZE - 1, 0, (struct sockaddr*)&senderAddr, &len);
-        if (n < 0) continue;
-        buffer[n] = '\0';
-
-        std::stringstream ss(buffer);
-        std::string type;
-        ss >> type;
-  // Handle status update from elevator
-        if (type == "STATUS") {
-            int id, floor;
-            ss >> id >> floor;
-            elevatorFloors[id] = floor;
-            elevatorLoad[id] = std::max(0, elevatorLoad[id] - 1);
-
-            // Mark elevator as REACHED if not warned in last 5 seconds
-            
-            auto now = std::chrono::steady_clock::now();
-            if (warningTimestamps.count(id) == 0 ||
-                std::chrono::duration_cast<std::chrono::seconds>(now - warningTimestamps[id]).count() > 5) {
-                elevatorStatus[id] = "REACHED";
+        Clock::time_point due = std::min({nextWarningExpiry(), batchDue, nextRetransmit()});
+        int timeoutMs = -1;
+        if (due != Clock::time_point::max()) {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(due - clock.now()) +
+                        std::chrono::milliseconds(1); // Round up so the deadline has passed on return
+            timeoutMs = (int)std::max<long long>(0, left.count());
+        }
+        if (shmInbox && !shmInbox->readyToSleep()) timeoutMs = 0;
+        if (uring) {
+            // Also sends what flushCommands() queued on the last pass
+            uring->wait(timeoutMs, [this](const char* data, size_t len, const struct sockaddr_in* from) {
+                datagramsReceived++;
+                if (len > 0) handleDatagram(data, len, from); // Empty, it is a shared-memory doorbell
+            });
+            uringEnters = uring->enterCalls();
+            if (uring->takeWatched()) drainForwarded();
+        } else {
+            epollWaits++;
+            struct epoll_event ready[2];
+            int n = epoll_wait(epfd, ready, 2, timeoutMs);
+            for (int i = 0; i < n; ++i) {
+                if (ready[i].data.fd == sockfd) {
+                    drainSocket();
+                } else {
+                    drainForwarded();
+                }
+            }
+        }
+        if (shmInbox) {
+            shmInbox->awake();
+            shmReceived += shmInbox->drain([this](const char* data, size_t len) { handleDatagram(data, len); });
+        }
+
+        expireWarnings(); // Wakes the dispatcher if a car came back
+        if (consumeWakeup()) {
+            if (batchWindow == Clock::duration::zero()) {
+                dispatchPending();
+            } else if (batchDue == Clock::time_point::max()) {
+                // Let the burst build up, then assign everything at once
+                batchDue = clock.now() + batchWindow;
+            }
+        }
+        if (batchDue != Clock::time_point::max() && clock.now() >= batchDue) {
+            batchDue = Clock::time_point::max();
+            dispatchPending();
+        }
+        handleRetransmits();
+        flushCommands();
+    }
+}
+
+// Reads every datagram waiting on the socket, RECV_BATCH per recvmmsg call,
+// and applies them in arrival order
+void Scheduler::drainSocket() {
+    static thread_local char buffers[RECV_BATCH][BUFFER_SIZE]; // One set per shard
+    struct mmsghdr msgs[RECV_BATCH];
+    struct iovec iovs[RECV_BATCH];
+    struct sockaddr_in senders[RECV_BATCH]; // For a HELLO that leaves its address to us
+    while (true) {
+        for (int i = 0; i < RECV_BATCH; ++i) {
+            iovs[i] = {buffers[i], BUFFER_SIZE - 1};
+            msgs[i] = {};
+            msgs[i].msg_hdr.msg_name = &senders[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(senders[i]);
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        int n = recvmmsg(sockfd, msgs, RECV_BATCH, MSG_DONTWAIT, nullptr);
+        if (n <= 0) return;
+        datagramsReceived += n;
+        recvCalls++;
+        for (int i = 0; i < n; ++i) {
+            if (msgs[i].msg_len == 0) continue; // A doorbell: the news is in the shared-memory ring
+            buffers[i][msgs[i].msg_len] = '\0';
+            handleDatagram(buffers[i], msgs[i].msg_len, &senders[i]);
+        }
+        if (n < RECV_BATCH) return; // The socket is empty
+    }
+}
+
+// Applies one datagram in either format. Malformed datagrams, and reports
+// from cars that have not registered, are counted and dropped. A shard hands
+// a car's datagram to the car's owner, and keeps hall calls unless it has no
+// cars to give them.
+void Scheduler::handleDatagram(const char* data, size_t len, const struct sockaddr_in* from) {
+    Report report;
+    bool binary = isWireMessage(data, len);
+    if (binary ? !decodeReport(data, len, report) : !parseReport(std::string_view(data, len), report)) {
+        rejectDatagram();
+        if (binary) {
+            // A car on another protocol version is answered in text from now on
+            WireHeader header = getWire<WireHeader>(data, 0);
+            if (header.version != WIRE_VERSION && fleet.isRegistered(header.elevatorID)) {
+                notePeerFormat(header.elevatorID, false);
+            }
+        }
+        return;
+    }
+    if (!inBuilding(report)) {
+        rejectDatagram();
+        return;
+    }
+    if (report.type == MsgType::REQUEST) {
+        for (size_t i = 1; registeredCars == 0 && i < shards.size(); ++i) {
+            Scheduler* peer = shards[(shardIndex + i) % shards.size()];
+            if (peer->statsView().registeredCars > 0) {
+                forward(peer, data, len, from);
+                return;
+            }
+        }
+        Request req(report.floor, report.targetFloor, report.down ? "DOWN" : "UP", clock.now());
+        if (from) req.source = *from;
+        req.binary = binary;
+        if (binary) req.seq = getWire<WireHeader>(data, 0).seq;
+        if (admit(req)) enqueue(req);
+        return;
+    }
+    int id = report.elevatorID;
+    if (!ownsElevator(id)) {
+        forward(shards[shardOf(id)], data, len, from); // Parsed again there; only strays take this path
+        return;
+    }
+    if (report.type == MsgType::HELLO) {
+        applyHello(id, report, from);
+        if (fleet.isRegistered(id)) notePeerFormat(id, binary);
+        return;
+    }
+    if (!fleet.isRegistered(id)) {
+        rejectDatagram();
+        return;
+    }
+    if (report.type == MsgType::BYE) {
+        deregisterElevator(id);
+        return;
+    }
+    notePeerFormat(id, binary);
+    switch (report.type) {
+    case MsgType::STATUS: applyStatus(id, report.floor); break;
+    case MsgType::ARRIVED: applyArrival(id, report.floor); break;
+    case MsgType::POSITION: applyPosition(id, report.floor); break;
+    case MsgType::HEARTBEAT: applyHeartbeat(id, report.floor); break;
+    case MsgType::ACK: applyAck(id, report.ackedSeq); break;
+    case MsgType::FAULT: applyFault(id); break;
+    default: applyWarning(id, report.warnings); break;
+    }
+}
+
+// Applies one NUL-terminated text message from an elevator or a client
+void Scheduler::handleMessage(const char* msg) {
+    handleDatagram(msg, std::strlen(msg));
+}
+
+void Scheduler::rejectDatagram() {
+    rejectedDatagrams++;
+    publishStats();
+}
+
+// A floor outside the building would end up in a car's plan and route, so it
+// is dropped before it reaches the fleet or the queue. Faults, warnings, ACKs
+// and BYEs carry no floor the scheduler uses.
+bool Scheduler::inBuilding(const Report& report) const {
+    auto inside = [this](int floor) { return floor >= 0 && floor <= floorCount; };
+    switch (report.type) {
+    case MsgType::REQUEST: return inside(report.floor) && inside(report.targetFloor);
+    case MsgType::STATUS:
+    case MsgType::ARRIVED:
+    case MsgType::POSITION:
+    case MsgType::HEARTBEAT:
+    case MsgType::HELLO: return inside(report.floor);
+    default: return true;
+    }
+}
+
+// Any thread may push to another shard's ring; the eventfd wakes its loop. A
+// full ring drops the datagram like a lost one.
+void Scheduler::forward(Scheduler* to, const char* data, size_t len, const struct sockaddr_in* from) {
+    ForwardedDatagram msg;
+    msg.hasFrom = from != nullptr;
+    if (from) msg.from = *from;
+    msg.len = (uint16_t)std::min<size_t>(len, BUFFER_SIZE - 1);
+    std::memcpy(msg.data, data, msg.len);
+    if (!to->forwardRing->tryPush(msg)) {
+        rejectDatagram();
+        return;
+    }
+    uint64_t one = 1;
+    if (write(to->forwardFd, &one, sizeof(one)) < 0) perror("[Scheduler] Shard wakeup failed");
+    forwarded++;
+    publishStats();
+}
+
+// The eventfd is cleared first, so a push that races with the drain still
+// leaves it set for the next wait
+void Scheduler::drainForwarded() {
+    uint64_t count;
+    if (read(forwardFd, &count, sizeof(count)) < 0 && errno != EAGAIN) perror("[Scheduler] Shard wakeup failed");
+    ForwardedDatagram msg;
+    while (forwardRing->tryPop(msg)) {
+        msg.data[msg.len] = '\0';
+        handleDatagram(msg.data, msg.len, msg.hasFrom ? &msg.from : nullptr);
+    }
+}
+
+// Handle a car announcing itself. It is reached at the address in the HELLO,
+// or at the one it sent from if it gave none. A car already registered has
+// restarted, so whatever it was doing is forgotten.
+void Scheduler::applyHello(int id, const Report& report, const struct sockaddr_in* from) {
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(report.port);
+    if (report.address != 0) {
+        addr.sin_addr.s_addr = report.address;
+    } else if (from) {
+        addr.sin_addr = from->sin_addr;
+    } else {
+        inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    }
+    if (report.port == 0 || !registerElevator(id, addr, report.capabilities)) {
+        rejectDatagram();
+        return;
+    }
+    char ip[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &addr.sin_addr, ip, sizeof(ip));
+    std::cout << "[Scheduler] Elevator " << id << " registered at " << ip << ":" << report.port << std::endl;
+    applyStatus(id, report.floor);
+}
+
+// Handle status update from elevator
+void Scheduler::applyStatus(int id, int floor) {
+    auto now = clock.now();
+    fleet.floorOf(id) = floor;
+    fleet.lastUpdateOf(id) = now;
+
+    // Mark elevator as REACHED if not warned in last WARNING_HOLD_S seconds
+    Clock::time_point warned = fleet.warningTimeOf(id);
+    if (warned == FleetTable::NEVER ||
+        std::chrono::duration_cast<std::chrono::seconds>(now - warned).count() > WARNING_HOLD_S) {
+        fleet.statusOf(id) = ElevatorState::REACHED;
+        fleet.warningsOf(id) = WARN_NONE;
+    }
+    // A route sent after the car's last stop has not been started yet
+    if (!routes[FleetTable::slot(id)].empty() && fleet.statusOf(id) == ElevatorState::REACHED) {
+        fleet.statusOf(id) = ElevatorState::MOVING;
+    }
+    refreshElevator(id);
+}
+
+// Handle a stop completed by an elevator on its route
+void Scheduler::applyArrival(int id, int floor) {
+    fleet.floorOf(id) = floor;
+    fleet.lastUpdateOf(id) = clock.now();
+    fleet.stopsDoneOf(id)++;
+    arriveAt(id, floor);
+    refreshElevator(id);
+}
+
+// Handle a floor passed by a moving elevator. Only its position changes; the
+// car is still on its route, so it does not become available.
+void Scheduler::applyPosition(int id, int floor) {
+    fleet.floorOf(id) = floor;
+    fleet.lastUpdateOf(id) = clock.now();
+    refreshElevator(id);
+}
+
+// Handle a heartbeat from an idle elevator. Cars only report changes, so a
+// heartbeat whose floor disagrees with the table means a STATUS was lost, and
+// one from a car marked failed means it is back.
+void Scheduler::applyHeartbeat(int id, int floor) {
+    fleet.lastUpdateOf(id) = clock.now();
+    if (!routes[FleetTable::slot(id)].empty()) return;
+    if (fleet.floorOf(id) != floor || fleet.statusOf(id) == ElevatorState::FAULT) applyStatus(id, floor);
+}
+
+// Handle a car acknowledging a route. Only the latest route is waited for;
+// the round trip is sampled only if it was sent once (Karn's rule), and the
+// timeout follows the smoothed round trip as in TCP (RFC 6298).
+void Scheduler::applyAck(int id, uint32_t seq) {
+    UnackedRoute& route = unacked[FleetTable::slot(id)];
+    if (!route.pending || route.seq != seq) return;
+    route.pending = false;
+    acksReceived++;
+    if (route.retries == 0) {
+        Clock::duration rtt = clock.now() - route.sentAt;
+        ackRttTotal += rtt;
+        ackRttMax = std::max(ackRttMax, rtt);
+        ackRttSamples++;
+        if (ackRttSamples == 1) {
+            srtt = rtt;
+            rttvar = rtt / 2;
+        } else {
+            Clock::duration err = srtt > rtt ? srtt - rtt : rtt - srtt;
+            rttvar = (3 * rttvar + err) / 4;
+            srtt = (7 * srtt + rtt) / 8;
+        }
+        rto = std::clamp<Clock::duration>(srtt + 4 * rttvar, std::chrono::milliseconds(ROUTE_RTO_MIN_MS),
+                                          std::chrono::milliseconds(ROUTE_RTO_MAX_MS));
+    }
+    publishStats();
+}
+
+// Handle elevator fault
+void Scheduler::applyFault(int id) {
+    fleet.statusOf(id) = ElevatorState::FAULT;
+    fleet.lastUpdateOf(id) = clock.now();
+    abandonPlan(id);
+    refreshElevator(id);
+}
+
+// Handle elevator warning
+void Scheduler::applyWarning(int id, uint32_t flags) {
+    fleet.statusOf(id) = ElevatorState::WARNING;
+    fleet.warningsOf(id) |= flags;
+    // A repeated warning moves the car's expiry rather than adding another
+    warnings.erase({fleet.warningTimeOf(id), id});
+    fleet.warningTimeOf(id) = clock.now();
+    fleet.lastUpdateOf(id) = fleet.warningTimeOf(id);
+    warnings.emplace(fleet.warningTimeOf(id), id);
+    refreshElevator(id);
+    wakeDispatcher(); // Picks up the new expiry deadline
+}
+
+// A car is answered in the format it last used, unless text is forced. When
+// that changes mid-route the route is sent again, since the car may not have
+// understood the last one.
+void Scheduler::notePeerFormat(int id, bool binary) {
+    int slot = FleetTable::slot(id);
+    bool useBinary = binary && !textOnly;
+    if (binaryPeers[slot] == useBinary) return;
+    binaryPeers[slot] = useBinary;
+    if (!routes[slot].empty()) {
+        sendRoute(id, fleet.stopsDone[slot], std::vector<int>(routes[slot].begin(), routes[slot].end()));
+    }
+}
+
+// Hands a request to the dispatch stage. Both run on the event loop, so a full
+// inbox is emptied into the pending queue right away.
+void Scheduler::enqueue(const Request& req) {
+    if (inbox.size() >= REQUEST_INBOX_SIZE) {
+        inboxFlushes++;
+        collectRequests();
+    }
+    inbox.push_back(req);
+    wakeDispatcher();
+}
+
+// Admission control, before a call is queued: the sender's token bucket
+// first, then the queue bound under the overload policy. A call turned away
+// is NAKed, so its client can back off and send it again.
+bool Scheduler::admit(const Request& req) {
+    uint32_t retryAfterMs;
+    if (admissionRate > 0 && !takeToken(req.source, retryAfterMs)) {
+        requestsRefused++;
+        sendNak(req, NAK_RATE_LIMITED, retryAfterMs);
+        return false;
+    }
+    if (queueLimit == 0) return true;
+    collectRequests();
+    size_t depth = requestQueue.size();
+    if (depth < queueLimit) return true;
+    switch (overloadPolicy) {
+    case OverloadPolicy::SHED_OLDEST:
+        // The oldest call has waited longest already; its client may still get a car sooner by asking again
+        requestsShed++;
+        sendNak(requestQueue.front(), NAK_SHED, OVERLOAD_RETRY_MS);
+        requestQueue.pop_front();
+        return true;
+    case OverloadPolicy::DEGRADE:
+        if (!degraded) {
+            degraded = true;
+            configuredWindow = batchWindow;
+            if (batchWindow == Clock::duration::zero()) batchWindow = std::chrono::milliseconds(OVERLOAD_BATCH_MS);
+            std::cerr << "[Scheduler] " << depth << " calls waiting; dispatching in batches" << std::endl;
+        }
+        if (depth < 2 * queueLimit) return true;
+        break;
+    case OverloadPolicy::REJECT:
+        break;
+    }
+    requestsRefused++;
+    sendNak(req, NAK_QUEUE_FULL, OVERLOAD_RETRY_MS);
+    return false;
+}
+
+// Token bucket per sender address and port. A call without an address, from
+// the shared-memory ring, draws on one bucket shared by every such sender.
+// Buckets that have refilled completely hold nothing worth keeping and are
+// dropped when the table is full; a new sender beyond that is refused.
+bool Scheduler::takeToken(const struct sockaddr_in& source, uint32_t& retryAfterMs) {
+    uint64_t key = (uint64_t)source.sin_addr.s_addr << 16 | source.sin_port;
+    Clock::time_point now = clock.now();
+    auto bucket = buckets.find(key);
+    if (bucket == buckets.end()) {
+        if (buckets.size() >= ADMISSION_MAX_SOURCES) {
+            for (auto it = buckets.begin(); it != buckets.end();) {
+                double idle = std::chrono::duration<double>(now - it->second.refilled).count();
+                it = it->second.tokens + idle * admissionRate >= admissionBurst ? buckets.erase(it) : std::next(it);
             }
-        } else if (type == "FAULT") {
-             // Handle elevator fault
-            int id;
-            ss >> id;
-            elevatorStatus[id] = "FAULT";
-        } else if (type == "WARNING") {
-            // Handle elevator warning
-            int id; std::string warning;
-            ss >> id >> warning;
-            elevatorStatus[id] = "WARNING(" + warning + ")";
-            warningTimestamps[id] = std::chrono::steady_clock::now();
+        }
+        if (buckets.size() >= ADMISSION_MAX_SOURCES) {
+            retryAfterMs = OVERLOAD_RETRY_MS;
+            return false;
+        }
+        bucket = buckets.emplace(key, TokenBucket{admissionBurst, now}).first;
+    }
+    TokenBucket& b = bucket->second;
+    b.tokens = std::min(admissionBurst, b.tokens + std::chrono::duration<double>(now - b.refilled).count() * admissionRate);
+    b.refilled = now;
+    if (b.tokens >= 1) {
+        b.tokens -= 1;
+        return true;
+    }
+    retryAfterMs = (uint32_t)std::ceil((1 - b.tokens) / admissionRate * 1000); // Until the next token
+    return false;
+}
+
+// Queued like a route and sent at the end of the pass, in the format the call
+// came in. A call that came without an address cannot be answered.
+void Scheduler::sendNak(const Request& req, NakReason reason, uint32_t retryAfterMs) {
+    publishStats();
+    if (req.source.sin_port == 0) return;
+    bool binary = req.binary && !textOnly;
+    outbox.push_back({0, binary ? encodeNak(req, reason, retryAfterMs) : formatNak(req, reason, retryAfterMs),
+                      req.source});
+}
+
+// Text NAK: "NAK <RATE|FULL|SHED> <retry_after_ms> <floor> <UP|DOWN> <target_floor>"
+std::string Scheduler::formatNak(const Request& req, NakReason reason, uint32_t retryAfterMs) {
+    return std::string("NAK ") + nakReasonName(reason) + " " + std::to_string(retryAfterMs) + " " +
+           std::to_string(req.floor) + " " + req.direction + " " + std::to_string(req.targetFloor);
+}
+
+std::string Scheduler::encodeNak(const Request& req, NakReason reason, uint32_t retryAfterMs) {
+    std::string msg(wireSize(MsgType::NAK), '\0');
+    size_t at = putWire(&msg[0], 0, wireHeader(MsgType::NAK, 0, req.seq, clock.now(), req.floor, reason));
+    putWire(&msg[0], at, retryAfterMs);
+    return msg;
+}
+
+void Scheduler::noteQueueDepth() {
+    if (requestQueue.size() <= queueHighWater) return;
+    queueHighWater = requestQueue.size();
+    publishStats();
+}
+
+// Back to the configured dispatch once a degraded queue is down to half its limit
+void Scheduler::relieveOverload() {
+    if (!degraded || requestQueue.size() > queueLimit / 2) return;
+    degraded = false;
+    batchWindow = configuredWindow;
+    std::cerr << "[Scheduler] Backlog cleared; dispatching as configured" << std::endl;
+}
+
+// Moves handed-over requests into the pending queue. Most are newer than
+// everything queued and go to the back; requests a faulted car gave up are
+// older and are slotted in by arrival time.
+void Scheduler::collectRequests() {
+    for (Request& req : inbox) {
+        if (requestQueue.empty() || !(req.arrival < requestQueue.back().arrival)) {
+            requestQueue.push_back(std::move(req));
         } else {
-            handleClientRequest(ss, type);
+            restoreRequests({req});
         }
     }
+    inbox.clear();
+    noteQueueDepth();
 }
-// Parse and enqueue a new client request
-void Scheduler::handleClientRequest(std::stringstream& ss, const std::string& firstToken) {
-    int floor = std::stoi(firstToken);
-    std::string direction;
-    int targetFloor;
-    ss >> direction >> targetFloor;
 
-    std::lock_guard<std::mutex> lock(queueMutex);
-    requestQueue.emplace(floor, targetFloor, direction);
-    cv.notify_one();
+// Pops the oldest queued request without blocking
+bool Scheduler::nextRequest(Request& req) {
+    collectRequests();
+    if (requestQueue.empty()) return false;
+    req = requestQueue.front();
+    requestQueue.pop_front();
+    return true;
 }
-// Continuously processes queued requests and assigns them to elevators
-void Scheduler::processRequests() {
-    while (true) {
-        std::unique_lock<std::mutex> lock(queueMutex);
-        cv.wait(lock, [this] { return !requestQueue.empty(); });
-
-        Request req = requestQueue.front();
-        requestQueue.pop();
-        lock.unlock();
-
-        int elevatorID = findBestElevator(req);
-        if (elevatorID != -1) {
-            sendMoveCommand(elevatorID, req.targetFloor);
-            moveCount++;
-            requestsHandled++;
-            elevatorLoad[elevatorID]++;
+
+// Pops every queued request, oldest first
+std::vector<Request> Scheduler::drainRequests() {
+    collectRequests();
+    std::vector<Request> batch(requestQueue.begin(), requestQueue.end());
+    requestQueue.clear();
+    return batch;
+}
+
+// Adds a request to the end of the queue
+void Scheduler::requeue(const Request& req) {
+    enqueue(req);
+}
+
+// Merges requests that could not be assigned back into the queue by arrival
+// time, so they stay ahead of anything that arrived after them. Does not wake
+// the dispatcher: they only become assignable when a car does.
+void Scheduler::restoreRequests(const std::vector<Request>& batch) {
+    auto pos = requestQueue.begin();
+    for (const Request& req : batch) {
+        pos = std::upper_bound(pos, requestQueue.end(), req,
+                               [](const Request& a, const Request& b) { return a.arrival < b.arrival; });
+        pos = requestQueue.insert(pos, req) + 1;
+    }
+    noteQueueDepth();
+}
+
+// Tells the dispatcher a request arrived or a car became available
+void Scheduler::wakeDispatcher() {
+    wakeup = true;
+}
+
+// True once for every wakeDispatcher() or new request since the last call
+bool Scheduler::consumeWakeup() {
+    bool woken = wakeup;
+    wakeup = false;
+    return woken;
+}
+
+// Tries every queued request in arrival order. Requests no car can take keep
+// their place in the queue until the next wakeup.
+int Scheduler::dispatchPending() {
+    collectRequests();
+    // Without collective control only idle cars take requests, so with none
+    // there is nothing to try
+    if (!collective && idleCars.size() == 0) return 0;
+    std::vector<Request> waiting = drainRequests();
+    int assigned;
+    if (batchWindow > Clock::duration::zero()) {
+        assigned = dispatchBatch(waiting);
+    } else {
+        std::vector<Request> left;
+        for (size_t i = 0; i < waiting.size(); ++i) {
+            if (!collective && idleCars.size() == 0) {
+                left.insert(left.end(), waiting.begin() + i, waiting.end());
+                break;
+            }
+            if (!tryDispatch(waiting[i])) left.push_back(waiting[i]);
+        }
+        assigned = (int)(waiting.size() - left.size());
+        waiting.swap(left);
+    }
+    restoreRequests(waiting);
+    relieveOverload();
+    return assigned;
+}
+
+// Sends the request to the best elevator, false if none can take it
+bool Scheduler::tryDispatch(const Request& req) {
+    expireWarnings();
+    int elevatorID = collective ? findCollectiveElevator(req) : findBestElevator(req);
+    if (elevatorID == -1) return false;
+    assign(req, elevatorID);
+    return true;
+}
+
+// Assigns the oldest requests so that the summed cost from car to pickup floor
+// is minimal. Each car offers one column per free seat (MAX_CAPACITY - load),
+// and every seat after the first costs an extra stop, so a car with spare
+// seats takes several calls when that beats sending another car. Idle cars
+// qualify, and under collective control so does a sweep already passing the
+// call. Requests beyond the free seats, or that no car can reach, stay in
+// 'batch' in arrival order, so a burst cannot starve them.
+// Every seat's distance is measured from where the car is now, not from the
+// pickup before it: the true cost of a seat depends on which calls fill the
+// others, which a linear assignment cannot express, so the extra-stop charge
+// stands in for the detour. All calls are booked before any route goes out,
+// so a car that takes several is re-planned and sent its route once.
+int Scheduler::dispatchBatch(std::vector<Request>& batch) {
+    expireWarnings();
+    struct Seat { int slot; int extraStops; };
+    std::vector<Seat> seats;
+    for (int slot = 0; slot < fleet.size(); ++slot) {
+        bool idle = isIdle(slot);
+        if (!idle && !(collective && fleet.status[slot] == ElevatorState::MOVING && !plans[slot].empty())) continue;
+        for (int k = 0; k < MAX_CAPACITY - fleet.load[slot]; ++k) seats.push_back({slot, k});
+    }
+    size_t take = std::min(batch.size(), seats.size());
+    if (take == 0) return 0;
+
+    const long NO_SEAT = LONG_MAX / 4; // Keeps the solver's sums from overflowing
+    std::vector<std::vector<long>> cost(take, std::vector<long>(seats.size()));
+    for (size_t r = 0; r < take; ++r) {
+        for (size_t c = 0; c < seats.size(); ++c) {
+            int slot = seats[c].slot;
+            long reach = isIdle(slot) ? std::abs(fleet.floor[slot] - batch[r].floor) : sweepCost(slot, batch[r]);
+            cost[r][c] = reach < 0 ? NO_SEAT : reach + STOP_COST_FLOORS * seats[c].extraStops;
+        }
+    }
+    std::vector<int> assignment = solveAssignment(cost);
+    std::vector<Request> left;
+    std::set<int> touched;
+    for (size_t r = 0; r < take; ++r) {
+        if (cost[r][assignment[r]] == NO_SEAT) {
+            left.push_back(batch[r]);
+        } else {
+            book(batch[r], seats[assignment[r]].slot + 1);
+            touched.insert(seats[assignment[r]].slot + 1);
+        }
+    }
+    for (int elevatorID : touched) {
+        replan(elevatorID);
+        refreshElevator(elevatorID);
+    }
+    int assigned = (int)(take - left.size());
+    left.insert(left.end(), batch.begin() + take, batch.end());
+    batch.swap(left);
+    return assigned;
+}
+
+// Books the passenger on the car and adds the pickup floor to its stops.
+// The car's route is re-planned, so the call is appended or slotted in between
+// the stops it already has.
+void Scheduler::assign(const Request& req, int elevatorID) {
+    book(req, elevatorID);
+    replan(elevatorID);
+    refreshElevator(elevatorID);
+}
+
+// The plan and load only; the caller re-plans the car's route
+void Scheduler::book(const Request& req, int elevatorID) {
+    plans[FleetTable::slot(elevatorID)][req.floor].pickups.push_back(req);
+    requestsHandled++;
+    fleet.loadOf(elevatorID)++;
+}
+
+// Collects and drops off passengers at the stop the car just reported.
+// Collected passengers' target floors are already on the route.
+void Scheduler::arriveAt(int elevatorID, int floor) {
+    int slot = FleetTable::slot(elevatorID);
+    std::deque<int>& route = routes[slot];
+    Direction sweep = fleet.direction[slot];
+    if (!route.empty() && route.front() == floor) route.pop_front();
+    if (route.empty()) {
+        fleet.legTarget[slot] = FleetTable::NO_LEG;
+        fleet.direction[slot] = Direction::IDLE;
+    } else {
+        fleet.legTarget[slot] = route.front();
+        if (route.front() != floor) fleet.direction[slot] = route.front() > floor ? Direction::UP : Direction::DOWN;
+    }
+
+    StopPlan& plan = plans[slot];
+    auto stop = plan.find(floor);
+    if (stop == plan.end()) return;
+    StopWork work = std::move(stop->second);
+    plan.erase(stop);
+    fleet.load[slot] -= work.dropoffs;
+    // Under collective control a car that turned around or made room can take
+    // calls it could not before
+    if (collective && (fleet.direction[slot] != sweep || work.dropoffs > 0)) wakeDispatcher();
+    for (const Request& req : work.pickups) {
+        pickups++;
+        totalWait += clock.now() - req.arrival;
+        if (req.targetFloor == floor) {
+            fleet.load[slot]--;
         } else {
-            std::this_thread::sleep_for(std::chrono::milliseconds(500));
-            std::lock_guard<std::mutex> relock(queueMutex);
-            requestQueue.push(req);
-            cv.notify_one();
+            plan[req.targetFloor].dropoffs++;
+        }
+    }
+}
+
+// Next floor in LOOK order: the closest stop ahead in 'dir', turning 'dir'
+// around when nothing is left ahead. An idle car heads for the closest stop.
+static int lookNext(const std::set<int>& stops, int at, Direction& dir) {
+    if (dir == Direction::IDLE) {
+        auto above = stops.lower_bound(at);
+        bool up = above != stops.end() &&
+                  (above == stops.begin() || *above - at <= at - *std::prev(above));
+        dir = up ? Direction::UP : Direction::DOWN;
+    }
+    if (dir == Direction::UP) {
+        auto ahead = stops.lower_bound(at);
+        if (ahead != stops.end()) return *ahead;
+        dir = Direction::DOWN;
+        return *stops.rbegin();
+    }
+    auto ahead = stops.upper_bound(at);
+    if (ahead != stops.begin()) return *std::prev(ahead);
+    dir = Direction::UP;
+    return *stops.begin();
+}
+
+// Orders every stop in the car's plan into a route: LOOK from the car's
+// position, where a passenger's target becomes a stop once their pickup floor
+// has been visited. A car mid-leg is planned from the next floor it can still
+// stop at, in the direction it is travelling, so a new stop on the way comes
+// before the one it is heading for; the car retargets when the route arrives
+// (Elevator::followItinerary). A car already at its stop, or heading for one
+// the plan no longer has, keeps that stop first.
+std::vector<int> Scheduler::planRoute(int elevatorID) {
+    int slot = FleetTable::slot(elevatorID);
+    std::set<int> stops;
+    std::multimap<int, int> boarding; // Pickup floor -> target floor
+    for (const auto& stop : plans[slot]) {
+        stops.insert(stop.first);
+        for (const Request& req : stop.second.pickups) {
+            if (req.targetFloor != req.floor) boarding.emplace(req.floor, req.targetFloor);
         }
     }
+
+    std::vector<int> route;
+    int at = fleet.floor[slot];
+    Direction dir = fleet.direction[slot];
+    int leg = routes[slot].empty() ? FleetTable::NO_LEG : routes[slot].front();
+    auto visit = [&](int floor) {
+        route.push_back(floor);
+        stops.erase(floor);
+        auto boarded = boarding.equal_range(floor);
+        for (auto it = boarded.first; it != boarded.second; ++it) stops.insert(it->second);
+        boarding.erase(boarded.first, boarded.second);
+        at = floor;
+    };
+    if (leg != FleetTable::NO_LEG && leg != at && stops.count(leg)) {
+        // Mid-leg the car can still be sent to any stop from the next floor it
+        // can stop at up to the one it is heading for
+        at = nextStoppableFloor(slot);
+        dir = leg > fleet.floor[slot] ? Direction::UP : Direction::DOWN;
+    } else if (leg != FleetTable::NO_LEG) {
+        visit(leg); // At its stop already, or a stop the plan no longer has
+    }
+    while (!stops.empty()) {
+        int next = lookNext(stops, at, dir);
+        if (route.empty()) fleet.direction[slot] = dir; // Sweep of the first leg
+        visit(next);
+    }
+    return route;
 }
-// Finds the best elevator for a request based on availability and proximity
+
+// Sends the car its re-planned route if it changed
+void Scheduler::replan(int elevatorID) {
+    if (fleet.statusOf(elevatorID) == ElevatorState::FAULT) return;
+    int slot = FleetTable::slot(elevatorID);
+    std::vector<int> route = planRoute(elevatorID);
+    if (std::equal(route.begin(), route.end(), routes[slot].begin(), routes[slot].end())) return;
+
+    sendRoute(elevatorID, fleet.stopsDone[slot], route);
+    routes[slot].assign(route.begin(), route.end());
+    moveCount++;
+    if (route.empty()) {
+        fleet.legTarget[slot] = FleetTable::NO_LEG;
+        fleet.direction[slot] = Direction::IDLE;
+        return;
+    }
+    fleet.legTarget[slot] = route.front();
+    // A warned car finishes its route but keeps showing the warning
+    if (fleet.status[slot] != ElevatorState::WARNING) fleet.status[slot] = ElevatorState::MOVING;
+}
+
+// A faulted car will not move again: hall calls it had not reached yet go back
+// into the queue by arrival time, so they come before any call that arrived
+// after them; passengers already on board stay with the car
+void Scheduler::abandonPlan(int elevatorID) {
+    StopPlan& plan = plans[FleetTable::slot(elevatorID)];
+    std::vector<Request> uncollected;
+    for (auto& stop : plan) {
+        for (const Request& req : stop.second.pickups) uncollected.push_back(req);
+        fleet.loadOf(elevatorID) -= (int)stop.second.pickups.size();
+    }
+    plan.clear();
+    routes[FleetTable::slot(elevatorID)].clear();
+    fleet.legTargetOf(elevatorID) = FleetTable::NO_LEG;
+    fleet.directionOf(elevatorID) = Direction::IDLE;
+    requestsHandled -= (int)uncollected.size();
+
+    std::sort(uncollected.begin(), uncollected.end(),
+              [](const Request& a, const Request& b) { return a.arrival < b.arrival; });
+    // Through the inbox, whose collection merges them in by arrival time
+    for (const Request& req : uncollected) enqueue(req);
+}
+
+// Finds the best elevator for a request based on availability and proximity.
+// The idle index only holds available cars under capacity, so this is a
+// bitmap search outward from the request floor rather than a scan of the fleet.
 int Scheduler::findBestElevator(const Request& req) {
-    int best = -1, minDist = INT_MAX;
-    for (int i = 1; i <= elevatorCount; ++i) {
-        if (elevatorStatus[i] != "OK" && elevatorStatus[i] != "REACHED") continue;
-        if (elevatorLoad[i] >= MAX_CAPACITY) continue;
-        int dist = std::abs(elevatorFloors[i] - req.floor);
-        if (dist < minDist) {
-            minDist = dist;
-            best = i;
+    int slot = idleCars.nearest(req.floor);
+    return slot < 0 ? -1 : slot + 1;
+}
+
+// Compares the nearest idle car with every car whose sweep will still pass the
+// call's floor in the call's direction. A sweeping car's cost is the distance
+// from its last floor plus STOP_COST_FLOORS per stop it makes on the way.
+int Scheduler::findCollectiveElevator(const Request& req) {
+    int best = findBestElevator(req);
+    long bestCost = best < 0 ? LONG_MAX : std::abs(fleet.floorOf(best) - req.floor);
+
+    for (int slot = 0; slot < fleet.size(); ++slot) {
+        long cost = sweepCost(slot, req);
+        if (cost < 0) continue;
+        if (cost < bestCost || (cost == bestCost && slot + 1 < best)) {
+            bestCost = cost;
+            best = slot + 1;
         }
     }
     return best;
 }
-// Sends a move command to a specific elevator
-void Scheduler::sendMoveCommand(int elevatorID, int targetFloor) {
-    struct sockaddr_in destAddr;
-    destAddr.sin_family = AF_INET;
-    destAddr.sin_port = htons(BASE_PORT + elevatorID);
-    destAddr.sin_addr.s_addr = inet_addr("127.0.0.1");
 
-    std::string cmd = "MOVE " + std::to_string(elevatorID) + " " + std::to_string(targetFloor);
-    sendto(sockfd, cmd.c_str(), cmd.length(), 0, (struct sockaddr*)&destAddr, sizeof(destAddr));
+// Cost of slotting the call into a car's sweep: the distance plus a stop's
+// worth for each stop it makes on the way, or -1 if the car is not heading
+// past the call in its direction with a free seat
+long Scheduler::sweepCost(int slot, const Request& req) const {
+    Direction callDir = req.direction == "DOWN" ? Direction::DOWN : Direction::UP;
+    if (fleet.direction[slot] != callDir || plans[slot].empty()) return -1;
+    if (fleet.status[slot] != ElevatorState::MOVING || fleet.load[slot] >= MAX_CAPACITY) return -1;
+    // The car takes new stops from the next floor it can stop at onwards
+    int reach = nextStoppableFloor(slot);
+    bool ahead = callDir == Direction::UP ? req.floor >= reach : req.floor <= reach;
+    if (!ahead) return -1;
+
+    // Stops strictly between the car's last floor and the call
+    const StopPlan& plan = plans[slot];
+    int low = std::min(fleet.floor[slot], req.floor), high = std::max(fleet.floor[slot], req.floor);
+    long stopsBefore = low == high ? 0 : std::distance(plan.upper_bound(low), plan.lower_bound(high));
+    return std::abs(fleet.floor[slot] - req.floor) + STOP_COST_FLOORS * stopsBefore;
+}
+
+// A car usually sends its last STATUS right after the warning, so waiting for
+// the next STATUS would keep a car with no more stops out of service for good
+void Scheduler::expireWarnings() {
+    auto now = clock.now();
+    while (!warnings.empty() &&
+           std::chrono::duration_cast<std::chrono::seconds>(now - warnings.begin()->first).count() > WARNING_HOLD_S) {
+        auto [warned, id] = *warnings.begin();
+        warnings.erase(warnings.begin());
+        // Another state change since then, or the car re-registering, takes precedence
+        if (!fleet.isRegistered(id) || fleet.statusOf(id) != ElevatorState::WARNING ||
+            fleet.warningTimeOf(id) != warned) {
+            continue;
+        }
+        bool moving = fleet.legTargetOf(id) != FleetTable::NO_LEG;
+        fleet.statusOf(id) = moving ? ElevatorState::MOVING : ElevatorState::REACHED;
+        fleet.warningsOf(id) = WARN_NONE;
+        refreshElevator(id);
+    }
+}
+
+// When the oldest outstanding warning runs out, or max() if there is none
+Clock::time_point Scheduler::nextWarningExpiry() {
+    if (warnings.empty()) return Clock::time_point::max();
+    return warnings.begin()->first + std::chrono::seconds(WARNING_HOLD_S + 1);
+}
+
+bool Scheduler::isIdle(int slot) const {
+    return isAvailable(fleet.status[slot]) && fleet.load[slot] < MAX_CAPACITY &&
+           plans[slot].empty() && fleet.legTarget[slot] == FleetTable::NO_LEG;
+}
+
+// A car on a leg reports each floor it passes. By the time a new route reaches
+// it, it may already be past the floor it reported, so the first floor it can
+// still stop at is the next one along
+int Scheduler::nextStoppableFloor(int slot) const {
+    int leg = fleet.legTarget[slot], at = fleet.floor[slot];
+    if (leg == FleetTable::NO_LEG || leg == at) return at;
+    return at + (leg > at ? 1 : -1);
+}
+
+// Keeps the idle index in step with the car's floor, status and load, and
+// wakes the dispatcher when a car becomes available. Every change to a car
+// ends here, so this is also where the car and the counters are published for
+// the display thread.
+void Scheduler::refreshElevator(int id) {
+    int slot = FleetTable::slot(id);
+    bool wasIdle = idleCars.contains(slot);
+    bool idle = isIdle(slot);
+    idleCars.update(slot, fleet.floor[slot], idle);
+    carViews[slot].store(fleet.viewOf(id));
+    publishStats();
+    if (idle && !wasIdle) wakeDispatcher();
+}
+
+// Registration runs on the event loop like every other change to the fleet.
+// Slots are never renumbered, since a car's ID is its slot; the table grows to
+// the highest ID registered and gives back trailing slots as cars leave.
+bool Scheduler::registerElevator(int id, const struct sockaddr_in& addr, uint32_t caps) {
+    if (id < 1 || id > MAX_ELEVATORS) return false;
+    if (id > fleet.size()) resizeFleet(id);
+    int slot = FleetTable::slot(id);
+    if (fleet.status[slot] == ElevatorState::OFFLINE) {
+        registeredCars++;
+    } else {
+        abandonPlan(id); // Restarted: its calls go back to the queue
+    }
+    fleet.reset(id, ElevatorState::OK);
+    unacked[slot].pending = false;
+    elevatorAddrs[slot] = addr;
+    capabilities[slot] = caps;
+    carRings[slot] = sharedMemory && (caps & CAP_SHM) ? attachRing(ntohs(addr.sin_port)) : nullptr;
+    refreshElevator(id);
+    return true;
+}
+
+// A host's ring is mapped once for all its cars. One created since under the
+// same name belongs to a restarted host and replaces it.
+std::shared_ptr<ShmRing> Scheduler::attachRing(int port) {
+    std::shared_ptr<ShmRing> ring = ShmRing::attach(port);
+    if (!ring) return nullptr; // Not on this host, or gone: UDP it is
+    auto known = ringsByPort.find(port);
+    if (known != ringsByPort.end() && known->second->instance() == ring->instance()) return known->second;
+    ringsByPort[port] = ring;
+    return ring;
+}
+
+void Scheduler::deregisterElevator(int id) {
+    if (!fleet.isRegistered(id)) return;
+    abandonPlan(id);
+    fleet.reset(id, ElevatorState::OFFLINE);
+    unacked[FleetTable::slot(id)].pending = false;
+    std::shared_ptr<ShmRing> ring = std::move(carRings[FleetTable::slot(id)]);
+    int port = ntohs(elevatorAddrs[FleetTable::slot(id)].sin_port);
+    if (ring && ring.use_count() == 2) ringsByPort.erase(port); // Its host's last car
+    registeredCars--;
+    refreshElevator(id);
+    std::cout << "[Scheduler] Elevator " << id << " left" << std::endl;
+
+    int count = fleet.size();
+    while (count > 0 && fleet.status[count - 1] == ElevatorState::OFFLINE) count--;
+    if (count < fleet.size()) resizeFleet(count);
+}
+
+void Scheduler::resizeFleet(int count) {
+    int old = fleet.size();
+    fleet.resize(count, ElevatorState::OFFLINE);
+    plans.resize(count);
+    routes.resize(count);
+    binaryPeers.resize(count, false);
+    sendSeq.resize(count, 0);
+    unacked.resize(count);
+    elevatorAddrs.resize(count, sockaddr_in{});
+    capabilities.resize(count, CAP_NONE);
+    carRings.resize(count);
+    idleCars.resize(count);
+    // New slots read as OFFLINE before the display thread can see them
+    carViews.reserve(count);
+    for (int id = old + 1; id <= count; ++id) carViews[FleetTable::slot(id)].store(fleet.viewOf(id));
+    carViews.resize(count);
+}
+
+void Scheduler::publishStats() {
+    stats.store({moveCount, requestsHandled, pickups, totalWait, inboxFlushes, datagramsReceived, recvCalls,
+                 commandsSent, sendCalls, shmReceived, shmSent, epollWaits, uringEnters, forwarded, rejectedDatagrams,
+                 requestsRefused, requestsShed, queueHighWater, retransmits, acksReceived, routesGivenUp, ackRttTotal, ackRttMax, ackRttSamples, registeredCars});
+}
+
+CarView Scheduler::carView(int id) const {
+    return carViews[FleetTable::slot(id)].load();
+}
+
+StatsView Scheduler::statsView() const {
+    return stats.load();
+}
+
+StatsView Scheduler::groupStatsView() const {
+    StatsView total = statsView();
+    for (size_t i = 1; i < shards.size(); ++i) {
+        StatsView s = shards[(shardIndex + i) % shards.size()]->statsView();
+        total.moveCount += s.moveCount;
+        total.requestsHandled += s.requestsHandled;
+        total.pickups += s.pickups;
+        total.totalWait += s.totalWait;
+        total.inboxFlushes += s.inboxFlushes;
+        total.datagramsReceived += s.datagramsReceived;
+        total.recvCalls += s.recvCalls;
+        total.commandsSent += s.commandsSent;
+        total.sendCalls += s.sendCalls;
+        total.shmReceived += s.shmReceived;
+        total.shmSent += s.shmSent;
+        total.epollWaits += s.epollWaits;
+        total.uringEnters += s.uringEnters;
+        total.forwarded += s.forwarded;
+        total.rejectedDatagrams += s.rejectedDatagrams;
+        total.requestsRefused += s.requestsRefused;
+        total.requestsShed += s.requestsShed;
+        total.queueHighWater = std::max(total.queueHighWater, s.queueHighWater); // Each shard has its own queue
+        total.retransmits += s.retransmits;
+        total.acksReceived += s.acksReceived;
+        total.routesGivenUp += s.routesGivenUp;
+        total.ackRttTotal += s.ackRttTotal;
+        total.ackRttMax = std::max(total.ackRttMax, s.ackRttMax);
+        total.ackRttSamples += s.ackRttSamples;
+        total.registeredCars += s.registeredCars;
+    }
+    return total;
+}
+
+// Wire format of an itinerary: "ROUTE <id> <seen> <floor>..." where <seen> is
+// the number of ARRIVED reports the scheduler had applied when it built the route
+std::string Scheduler::formatRoute(int elevatorID, int seen, const std::vector<int>& stops) {
+    std::string cmd = "ROUTE " + std::to_string(elevatorID) + " " + std::to_string(seen);
+    for (int floor : stops) cmd += " " + std::to_string(floor);
+    return cmd;
+}
+
+// Binary form of formatRoute(), for cars that speak WIRE_VERSION
+std::string Scheduler::encodeRoute(int elevatorID, uint32_t seq, int seen, const std::vector<int>& stops) {
+    int count = (int)std::min<size_t>(stops.size(), WIRE_MAX_STOPS);
+    std::string msg(wireSize(MsgType::ROUTE, count), '\0');
+    size_t at = putWire(&msg[0], 0, wireHeader(MsgType::ROUTE, elevatorID, seq, clock.now(), 0, (uint8_t)count));
+    at = putWire(&msg[0], at, (uint32_t)seen);
+    at = putWire(&msg[0], at, schedulerEpoch);
+    for (int i = 0; i < count; ++i) at = putWire(&msg[0], at, (int16_t)stops[i]);
+    return msg;
+}
+
+// Queues an itinerary for a specific elevator; flushCommands() sends it. A
+// binary route is also kept until the car acknowledges it, with a timer to
+// resend it; text routes carry no sequence number and are sent once.
+void Scheduler::sendRoute(int elevatorID, int seen, const std::vector<int>& stops) {
+    int slot = FleetTable::slot(elevatorID);
+    uint32_t seq = ++sendSeq[slot];
+    UnackedRoute& route = unacked[slot];
+    if (!binaryPeers[slot]) {
+        route.pending = false;
+        outbox.push_back({elevatorID, formatRoute(elevatorID, seen, stops)});
+        return;
+    }
+    if (!(capabilities[slot] & CAP_ROUTE_ACK)) {
+        route.pending = false;
+        outbox.push_back({elevatorID, encodeRoute(elevatorID, seq, seen, stops)});
+        return;
+    }
+    route = {true, seq, encodeRoute(elevatorID, seq, seen, stops), clock.now(), 0};
+    outbox.push_back({elevatorID, route.msg});
+    retransmitWheel.schedule(wheelTick(route.sentAt + rto), {elevatorID, seq});
+}
+
+// Fires the retransmit timers that are due. Timers are not cancelled when an
+// ACK or a newer route arrives; retransmit() skips the ones that no longer apply.
+void Scheduler::handleRetransmits() {
+    retransmitWheel.advance(wheelTick(clock.now()),
+                            [this](const std::pair<int, uint32_t>& timer) { retransmit(timer.first, timer.second); });
+}
+
+Clock::time_point Scheduler::nextRetransmit() {
+    uint64_t tick = retransmitWheel.nextTick();
+    if (tick == TimerWheel<std::pair<int, uint32_t>>::NONE) return Clock::time_point::max();
+    return wheelEpoch + std::chrono::milliseconds(RETRANSMIT_TICK_MS) * tick;
+}
+
+// Resends with the timeout doubled each time. A car that acknowledges none of
+// ROUTE_MAX_RETRIES resends is treated as failed, so its calls go to other
+// cars; its next STATUS or HEARTBEAT brings it back.
+void Scheduler::retransmit(int id, uint32_t seq) {
+    if (!fleet.isRegistered(id)) return; // Left since; its timers are stale
+    UnackedRoute& route = unacked[FleetTable::slot(id)];
+    if (!route.pending || route.seq != seq) return;
+    if (route.retries == ROUTE_MAX_RETRIES) {
+        route.pending = false;
+        routesGivenUp++;
+        std::cerr << "[Scheduler] Elevator " << id << " did not acknowledge its route; marking it failed" << std::endl;
+        applyFault(id);
+        return;
+    }
+    route.retries++;
+    retransmits++;
+    outbox.push_back({id, route.msg});
+    Clock::duration backoff = std::min<Clock::duration>(rto * (1 << route.retries),
+                                                        std::chrono::milliseconds(ROUTE_RTO_MAX_MS));
+    retransmitWheel.schedule(wheelTick(clock.now() + backoff), {id, seq});
+    publishStats();
+}
+
+// Rounded up, so a timer never fires before its time
+uint64_t Scheduler::wheelTick(Clock::time_point t) const {
+    auto tick = std::chrono::milliseconds(RETRANSMIT_TICK_MS);
+    return (uint64_t)((t - wheelEpoch + tick - Clock::duration(1)) / tick);
+}
+
+// Sends every queued command, SEND_BATCH per sendmmsg call. Runs once per pass
+// of the event loop, so a burst of assignments costs a few syscalls.
+void Scheduler::flushCommands() {
+    // A car on this host gets its command through its ring, and a datagram
+    // only as a doorbell, empty, if it is asleep; a full ring falls back to UDP.
+    // Commands for a car that left in this same pass have nowhere to go.
+    // NAKs to clients always go by UDP.
+    size_t kept = 0;
+    for (OutboundCommand& cmd : outbox) {
+        if (cmd.elevatorID != 0 && !fleet.isRegistered(cmd.elevatorID)) continue;
+        ShmRing* ring = cmd.elevatorID ? carRings[FleetTable::slot(cmd.elevatorID)].get() : nullptr;
+        if (ring && ring->push(cmd.text.data(), cmd.text.size())) {
+            shmSent++;
+            if (!ring->takeDoorbell()) continue;
+            cmd.text.clear();
+        }
+        if (kept != (size_t)(&cmd - outbox.data())) outbox[kept] = std::move(cmd);
+        kept++;
+    }
+    outbox.resize(kept);
+    if (uring) {
+        for (OutboundCommand& cmd : outbox) {
+            const struct sockaddr_in& to = cmd.elevatorID ? elevatorAddrs[FleetTable::slot(cmd.elevatorID)] : cmd.to;
+            if (uring->send(to, cmd.text.data(), cmd.text.size())) commandsSent++;
+        }
+        outbox.clear();
+        return;
+    }
+    struct mmsghdr msgs[SEND_BATCH];
+    struct iovec iovs[SEND_BATCH];
+    size_t next = 0;
+    while (next < outbox.size()) {
+        int count = (int)std::min<size_t>(SEND_BATCH, outbox.size() - next);
+        for (int i = 0; i < count; ++i) {
+            OutboundCommand& cmd = outbox[next + i];
+            iovs[i] = {&cmd.text[0], cmd.text.size()};
+            msgs[i] = {};
+            msgs[i].msg_hdr.msg_name = cmd.elevatorID ? &elevatorAddrs[FleetTable::slot(cmd.elevatorID)] : &cmd.to;
+            msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        int sent = sendmmsg(sockfd, msgs, count, 0);
+        if (sent <= 0) break; // Dropped like any lost datagram; the next route update resends
+        commandsSent += sent;
+        sendCalls++;
+        next += sent;
+    }
+    outbox.clear();
+}
+
+// Prints the elevator status table, each car as its shard last published it
+void Scheduler::printStatus() {
+    std::cout << "\n---------------------------------------------\n";
+    std::cout << "| Elevator | Floor | Load | Status          |\n";
+    std::cout << "---------------------------------------------\n";
+    int count = 0;
+    for (Scheduler* member : shards) count = std::max(count, (int)member->carViews.size());
+    for (int i = 1; i <= count; ++i) {
+        const Scheduler* owner = shards[shardOf(i)];
+        if (i > (int)owner->carViews.size()) continue;
+        CarView car = owner->carView(i);
+        if (car.status == ElevatorState::OFFLINE) continue;
+        bool moving = car.status == ElevatorState::MOVING;
+        std::string floorDisplay = (moving ? "-" : std::to_string(car.floor));
+        std::cout << "|    " << std::setw(3) << i << "   |   " << std::setw(3) << floorDisplay
+                  << "  |  " << std::setw(2) << car.load << "  | "
+                  << std::setw(35) << statusText(car.status, car.warnings) << " |\n";
+    }
+}
 
-    elevatorStatus[elevatorID] = "MOVING";
-    elevatorFloors[elevatorID] = -1;
+// Prints the simulation counters
+void Scheduler::printStats() {
+    auto duration = std::chrono::duration_cast<std::chrono::seconds>(clock.now() - startTime);
+
+    std::cout << "\n=== Simulation Stats ===\n";
+    std::cout << "Simulation Time: " << duration.count() << " seconds\n";
+    StatsView counters = groupStatsView();
+    std::cout << "Total Moves: " << counters.moveCount << "\n";
+    std::cout << "Registered Elevators: " << counters.registeredCars << "\n";
+    std::cout << "Requests Handled: " << counters.requestsHandled << "\n";
+    std::cout << "Passengers Picked Up: " << counters.pickups << "\n";
+    std::cout << "Inbox Flushes: " << counters.inboxFlushes << "\n";
+    std::cout << std::fixed << std::setprecision(1);
+    if (counters.uringEnters) {
+        std::cout << "Datagrams per io_uring_enter: "
+                  << (double)(counters.datagramsReceived + counters.commandsSent) / counters.uringEnters << "\n";
+    } else {
+        std::cout << "Datagrams per recvmmsg: "
+                  << (counters.recvCalls ? (double)counters.datagramsReceived / counters.recvCalls : 0.0) << "\n";
+        std::cout << "Commands per sendmmsg: "
+                  << (counters.sendCalls ? (double)counters.commandsSent / counters.sendCalls : 0.0) << "\n";
+    }
+    std::cout << "Rejected Datagrams: " << counters.rejectedDatagrams << "\n";
+    std::cout << "Hall Calls Refused: " << counters.requestsRefused << ", Shed: " << counters.requestsShed
+              << ", Queue High Water: " << counters.queueHighWater << "\n";
+    if (shards.size() > 1) {
+        std::cout << "Shards: " << shards.size() << ", Datagrams Forwarded: " << counters.forwarded << "\n";
+    }
+    if (sharedMemory) {
+        std::cout << "Shared Memory: " << counters.shmReceived << " received, " << counters.shmSent
+                  << " commands sent\n";
+    }
+    std::cout << "Route ACKs: " << counters.acksReceived << ", Retransmits: " << counters.retransmits
+              << ", Cars Given Up: " << counters.routesGivenUp << "\n";
+    auto us = [](Clock::duration d) { return std::chrono::duration<double, std::micro>(d).count(); };
+    std::cout << "ACK Round Trip: avg "
+              << (counters.ackRttSamples ? us(counters.ackRttTotal) / counters.ackRttSamples : 0.0) << " us, max "
+              << us(counters.ackRttMax) << " us\n";
+    double wait = counters.pickups ? std::chrono::duration<double>(counters.totalWait).count() / counters.pickups : 0.0;
+    std::cout << "Average Wait: " << std::fixed << std::setprecision(2) << wait << " seconds\n";
+    std::cout.unsetf(std::ios::fixed);
+    std::cout << "---------------------------------------------\n";
 }
+
 // Periodically prints elevator statuses and stats
 void Scheduler::displayStatusLoop() {
+    int cycleCount = 0;
     while (true) {
-        std::this_thread::sleep_for(std::chrono::seconds(2));
-        std::cout << "\n---------------------------------------------\n";
-        std::cout << "| Elevator | Floor | Load | Status          |\n";
-        std::cout << "---------------------------------------------\n";
-        for (int i = 1; i <= elevatorCount; ++i) {
-            std::string floorDisplay = (elevatorFloors[i] == -1 ? "-" : std::to_string(elevatorFloors[i]));
-            std::cout << "|    " << std::setw(3) << i << "   |   " << std::setw(3) << floorDisplay
-                      << "  |  " << std::setw(2) << elevatorLoad[i] << "  | "
-                      << std::setw(35) << elevatorStatus[i] << " |\n";
-        }
-        static int cycleCount = 0;
+        clock.sleepFor(std::chrono::seconds(2));
+        printStatus();
         cycleCount++;
         if (cycleCount % 5 == 0) {
-            auto now = std::chrono::steady_clock::now();
-            auto duration = std::chrono::duration_cast<std::chrono::seconds>(now - startTime);
-
-            std::cout << "\n=== Simulation Stats ===\n";
-            std::cout << "Simulation Time: " << duration.count() << " seconds\n";
-            std::cout << "Total Moves: " << moveCount << "\n";
-            std::cout << "Requests Handled: " << requestsHandled << "\n";
-            std::cout << "---------------------------------------------\n";
+            printStats();
         }
     }
 }
+
+int Scheduler::getMoveCount() const {
+    return statsView().moveCount;
+}
+
+int Scheduler::getRequestsHandled() const {
+    return statsView().requestsHandled;
+}
+
+double Scheduler::getAverageWaitSeconds() const {
+    StatsView counters = statsView();
+    if (counters.pickups == 0) return 0.0;
+    return std::chrono::duration<double>(counters.totalWait).count() / counters.pickups;
+}
+
+void Scheduler::setBatchWindow(Clock::duration window) {
+    if (degraded) configuredWindow = window; // Taken up once the backlog clears
+    else batchWindow = window;
+}
+
+void Scheduler::setQueueLimit(size_t limit, OverloadPolicy policy) {
+    queueLimit = limit;
+    overloadPolicy = policy;
+}
+
+void Scheduler::setRateLimit(double rate, double burst) {
+    admissionRate = std::max(0.0, rate);
+    admissionBurst = std::max(1.0, burst);
+    buckets.clear();
+}
+
+size_t Scheduler::getQueueHighWater() const {
+    return queueHighWater;
+}
+
+uint64_t Scheduler::getRefusedRequests() const {
+    return requestsRefused;
+}
+
+uint64_t Scheduler::getShedRequests() const {
+    return requestsShed;
+}
+
+bool Scheduler::isDegraded() const {
+    return degraded;
+}
+
+Clock::duration Scheduler::getBatchWindow() const {
+    return batchWindow;
+}
+
+void Scheduler::setCollectiveControl(bool enabled) {
+    collective = enabled;
+}
+
+bool Scheduler::getCollectiveControl() const {
+    return collective;
+}
+
+void Scheduler::setSharedMemory(bool enabled) {
+    sharedMemory = enabled;
+}
+
+void Scheduler::setIoUring(bool enabled) {
+    ioUring = enabled;
+}
+
+bool Scheduler::usesSharedMemory(int id) const {
+    return carRings[FleetTable::slot(id)] != nullptr;
+}
+
+void Scheduler::setTextOnly(bool enabled) {
+    textOnly = enabled;
+}
+
+bool Scheduler::usesBinary(int id) const {
+    return binaryPeers[FleetTable::slot(id)];
+}
+
+uint64_t Scheduler::getRejectedDatagrams() const {
+    return rejectedDatagrams;
+}
+
+uint64_t Scheduler::getRetransmits() const {
+    return retransmits;
+}
+
+bool Scheduler::awaitingAck(int id) const {
+    return unacked[FleetTable::slot(id)].pending;
+}
+
+int Scheduler::getRegisteredCars() const {
+    return registeredCars;
+}
+
+const struct sockaddr_in& Scheduler::elevatorAddress(int id) const {
+    return elevatorAddrs[FleetTable::slot(id)];
+}
+
+size_t Scheduler::getQueuedRequests() {
+    collectRequests();
+    return requestQueue.size();
+}
+
 // Entry point: initializes scheduler with user-defined elevator and floor count
-#ifndef TEST_BUILD
-int main() {
+#if !defined(TEST_BUILD) && !defined(SIM_BUILD) && !defined(BENCH_BUILD)
+int main(int argc, char* argv[]) {
     int elevators, floors;
     std::cout << "Enter number of elevators: ";
     std::cin >> elevators;
     std::cout << "Enter number of floors: ";
     std::cin >> floors;
+    // Stops travel as int16 on the wire
+    if (!std::cin || floors < 0 || !isWireFloor(floors)) {
+        std::cerr << "Number of floors must be between 0 and " << INT16_MAX << std::endl;
+        return 1;
+    }
 
-    Scheduler scheduler(elevators, floors);
-    scheduler.start();
+    // ./scheduler [--batch <ms>] [--collective] [--text] [--shm] [--io-uring] [--shards <n>] [--bank-size <cars>]
+    //             [--queue-limit <calls>] [--overload reject|shed|degrade] [--rate-limit <calls/s>] [--burst <calls>]
+    Clock::duration batch{};
+    bool collective = false, textOnly = false, sharedMemory = false, ioUring = false;
+    int shardCount = 1, bankSize = SHARD_BANK_SIZE;
+    size_t queueLimit = REQUEST_QUEUE_MAX;
+    OverloadPolicy overload = OverloadPolicy::REJECT;
+    double rate = 0, burst = 0;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--batch" && i + 1 < argc) {
+            // Assign requests in batches instead of one by one
+            batch = std::chrono::milliseconds(std::atoi(argv[++i]));
+        } else if (arg == "--collective") {
+            // Let cars pick up hall calls along their current sweep
+            collective = true;
+        } else if (arg == "--text") {
+            // Answer every car in the text format, for debugging
+            textOnly = true;
+        } else if (arg == "--shm") {
+            // Talk to peers on this host through shared-memory rings
+            sharedMemory = true;
+        } else if (arg == "--io-uring") {
+            ioUring = true;
+        } else if (arg == "--shards" && i + 1 < argc) {
+            // One receive thread per shard, each owning every <n>th bank of cars
+            shardCount = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--bank-size" && i + 1 < argc) {
+            bankSize = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--queue-limit" && i + 1 < argc) {
+            // Hall calls allowed to wait at once, 0 for no bound
+            queueLimit = (size_t)std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--overload" && i + 1 < argc) {
+            std::string policy = argv[++i];
+            overload = policy == "shed" ? OverloadPolicy::SHED_OLDEST
+                       : policy == "degrade" ? OverloadPolicy::DEGRADE
+                                             : OverloadPolicy::REJECT;
+        } else if (arg == "--rate-limit" && i + 1 < argc) {
+            // Hall calls a second each client may send
+            rate = std::atof(argv[++i]);
+        } else if (arg == "--burst" && i + 1 < argc) {
+            burst = std::atof(argv[++i]);
+        }
+    }
+
+    std::vector<std::unique_ptr<Scheduler>> shards;
+    std::vector<Scheduler*> group;
+    for (int i = 0; i < shardCount; ++i) {
+        shards.emplace_back(new Scheduler(shardCount == 1 ? elevators : 0, floors));
+        group.push_back(shards.back().get());
+    }
+    if (shardCount > 1) {
+        Scheduler::shard(group, bankSize);
+        for (int id = 1; id <= elevators; ++id) {
+            group[group[0]->shardOf(id)]->registerElevator(id, Scheduler::defaultAddress(id), CAP_ROUTE_ACK);
+        }
+    }
+    for (Scheduler* scheduler : group) {
+        scheduler->setBatchWindow(batch);
+        scheduler->setCollectiveControl(collective);
+        scheduler->setTextOnly(textOnly);
+        scheduler->setSharedMemory(sharedMemory);
+        scheduler->setIoUring(ioUring);
+        scheduler->setQueueLimit(queueLimit, overload);
+        scheduler->setRateLimit(rate, burst > 0 ? burst : rate);
+        scheduler->openSocket(); // In group order, which the steering program counts on
+    }
+    for (int i = 1; i < shardCount; ++i) std::thread(&Scheduler::start, group[i]).detach();
+    group[0]->start();
     return 0;
 }
 #endif
-
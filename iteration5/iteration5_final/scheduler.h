@@ -0,0 +1,366 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <set>
+#include <unordered_map>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <netinet/in.h>
+#include "clock.h"
+#include "fleet.h"
+#include "dispatch.h"
+#include "mpsc_ring.h"
+#include "seqlock.h"
+#include "shm_ring.h"
+#include "uring_socket.h"
+#include "timer_wheel.h"
+#include "wire.h"
+
+#define BUFFER_SIZE 1024
+#define BASE_PORT 5100
+#define SCHEDULER_PORT 5002
+#define MAX_CAPACITY 4
+#define MAX_ELEVATORS 65535    // Elevator IDs are 16 bits on the wire
+#define REQUEST_INBOX_SIZE 4096 // Requests parsed but not yet moved into the pending queue
+#define RECV_BATCH 64          // Datagrams read per recvmmsg call
+#define SEND_BATCH 64          // Commands written per sendmmsg call
+#define RETRANSMIT_TICK_MS 10  // Resolution of the retransmit timer wheel
+#define ROUTE_RTO_INITIAL_MS 200 // Retransmit timeout before any ACK round trip was measured
+#define ROUTE_RTO_MIN_MS 20
+#define ROUTE_RTO_MAX_MS 2000  // Backoff stops doubling here
+#define ROUTE_MAX_RETRIES 6    // Unacknowledged after this many resends, the car is treated as failed
+#define WARNING_HOLD_S 5      // A warned car takes no new requests for this many seconds
+#define STOP_COST_FLOORS 4   // An extra stop (doors plus the elevator's poll delay) costs about four floors of travel
+#define REQUEST_QUEUE_MAX 4096   // Hall calls waiting before the overload policy applies, by default
+#define OVERLOAD_RETRY_MS 1000   // How long a NAK for a full queue asks the client to wait
+#define OVERLOAD_BATCH_MS 500    // Batch window of a dispatcher degraded by overload
+#define ADMISSION_MAX_SOURCES 4096 // Token buckets kept; idle ones go first
+#define SHARD_BANK_SIZE 8      // Consecutive car IDs one shard owns together, unless set otherwise
+#define SHARD_FORWARD_RING 256 // Datagrams a shard can hold for another before dropping them
+
+// Structure to represent a client request
+struct Request {
+    int floor;
+    int targetFloor;
+    std::string direction;
+    Clock::time_point arrival; // When the scheduler received the request
+    struct sockaddr_in source = {}; // Who to NAK, port 0 if unknown
+    uint32_t seq = 0;          // The sender's, for a binary NAK
+    bool binary = false;       // Came in the wire format
+    Request() : Request(0, 0, "") {} // Empty ring cell
+    Request(int f, int t, const std::string& d, Clock::time_point a = {})
+        : floor(f), targetFloor(t), direction(d), arrival(a) {}
+};
+
+// Work a car still has to do at one floor of its plan
+struct StopWork {
+    std::vector<Request> pickups; // Hall calls collected here; their target becomes a dropoff
+    int dropoffs = 0;             // Passengers on board getting off here
+};
+
+// A car's stops keyed by floor, so the next stop in either direction is a map lookup
+using StopPlan = std::map<int, StopWork>;
+
+// What happens to a hall call that finds the queue full
+enum class OverloadPolicy {
+    REJECT,      // NAK it
+    SHED_OLDEST, // Queue it and NAK the oldest waiting call instead
+    DEGRADE,     // Queue it and dispatch in batches, which clears a backlog faster, until twice the limit
+};
+
+// A sender's allowance of hall calls, refilled at the admission rate
+struct TokenBucket {
+    double tokens;
+    Clock::time_point refilled;
+};
+
+// Scheduler counters as the display thread sees them
+struct StatsView {
+    int moveCount;
+    int requestsHandled;
+    int pickups;
+    Clock::duration totalWait;
+    uint64_t inboxFlushes;
+    uint64_t datagramsReceived;
+    uint64_t recvCalls;
+    uint64_t commandsSent;
+    uint64_t sendCalls;
+    uint64_t shmReceived; // Messages taken from the shared-memory inbox
+    uint64_t shmSent;     // Commands put in a car's shared-memory ring
+    uint64_t epollWaits;  // epoll_wait calls
+    uint64_t uringEnters; // io_uring_enter calls, each both sending and receiving
+    uint64_t forwarded;   // Datagrams handed to the shard that owns their car
+    uint64_t rejectedDatagrams;
+    uint64_t requestsRefused; // Hall calls NAKed on arrival
+    uint64_t requestsShed;    // Hall calls dropped from the queue for newer ones
+    size_t queueHighWater;    // Most hall calls ever waiting at once
+    uint64_t retransmits;
+    uint64_t acksReceived;
+    uint64_t routesGivenUp;
+    Clock::duration ackRttTotal; // Over ACKs of routes sent once
+    Clock::duration ackRttMax;
+    uint64_t ackRttSamples;
+    int registeredCars;
+};
+
+// A command waiting for the end of the event loop pass
+struct OutboundCommand {
+    int elevatorID;           // 0 for a reply to a client
+    std::string text;
+    struct sockaddr_in to{};  // Where a client reply goes
+};
+
+// A datagram that reached a shard other than its car's, on its way to the owner
+struct ForwardedDatagram {
+    struct sockaddr_in from;
+    bool hasFrom;
+    uint16_t len;
+    char data[BUFFER_SIZE];
+};
+
+// The last binary ROUTE sent to a car, kept until the car acknowledges it
+struct UnackedRoute {
+    bool pending = false;
+    uint32_t seq = 0;
+    std::string msg;          // Sent again unchanged
+    Clock::time_point sentAt; // First transmission
+    int retries = 0;
+};
+
+// Main class that handles scheduling logic. The fleet grows and shrinks as cars
+// register with HELLO and leave with BYE; 'elevCount' cars are registered up
+// front at 127.0.0.1:BASE_PORT + ID for peers that never send HELLO.
+class Scheduler {
+public:
+    Scheduler(int elevCount, int floorMax, Clock& clock = Clock::real());
+    virtual ~Scheduler();
+
+    void start();
+    void openSocket();                          // Creates and binds the UDP socket if start() has not
+
+    // Splits one fleet across 'group', a scheduler per thread, each with its own
+    // SO_REUSEPORT socket on SCHEDULER_PORT. Blocks of 'bankSize' consecutive
+    // car IDs are dealt to the shards in turn, and a steering program makes the
+    // kernel deliver a car's binary datagrams to its owner; anything that lands
+    // elsewhere is handed over through the owner's forward ring. Before any of
+    // them opens its socket, which they then do in group order.
+    static void shard(const std::vector<Scheduler*>& group, int bankSize = SHARD_BANK_SIZE);
+    int shardOf(int id) const;                  // Index in the group of the shard that owns the car
+    bool ownsElevator(int id) const;
+    static struct sockaddr_in defaultAddress(int id); // Where a car that never sends HELLO listens
+
+    // Single-threaded entry points, shared by the event loop and the simulator.
+    // Everything except the views below runs on the one thread.
+    // Applies one binary or text datagram; 'from' fills in a HELLO that leaves its address out
+    void handleDatagram(const char* data, size_t len, const struct sockaddr_in* from = nullptr);
+    void handleMessage(const char* msg);        // Applies one text message from an elevator or client
+    void drainForwarded();                      // Applies the datagrams other shards handed over
+    bool nextRequest(Request& req);             // Pops the oldest queued request, if any
+    void requeue(const Request& req);           // Adds a request to the end of the queue
+    bool tryDispatch(const Request& req);       // Assigns a request, false if no elevator can take it
+    std::vector<Request> drainRequests();       // Pops every queued request, oldest first
+    int dispatchBatch(std::vector<Request>& batch); // Min-cost assignment over free seats; unassigned requests stay in 'batch'
+    void restoreRequests(const std::vector<Request>& batch); // Merges unassigned requests back in arrival order
+    int dispatchPending();                      // Assigns what it can of the queue, the rest keeps its place
+    bool consumeWakeup();                       // True if a request arrived or a car freed up since the last call
+    void expireWarnings();                      // Returns cars whose warning has run out to service
+    void handleRetransmits();                   // Resends routes whose ACK is overdue
+    Clock::time_point nextRetransmit();         // When handleRetransmits() next has work, max() if never
+    Clock::time_point nextWarningExpiry();      // Next expireWarnings() that can free a car, max() if none
+    int findBestElevator(const Request& req);   // Selects best elevator for a request
+    int findCollectiveElevator(const Request& req); // Idle car or a sweep already passing the call, cheapest wins
+    std::vector<int> planRoute(int elevatorID); // The car's stops in the order it should make them
+    static std::string formatRoute(int elevatorID, int seen, const std::vector<int>& stops);
+    std::string encodeRoute(int elevatorID, uint32_t seq, int seen, const std::vector<int>& stops);
+    static std::string formatNak(const Request& req, NakReason reason, uint32_t retryAfterMs);
+    std::string encodeNak(const Request& req, NakReason reason, uint32_t retryAfterMs);
+
+    // Any thread: the state last published by the event loop, read without locking
+    CarView carView(int id) const;
+    StatsView statsView() const;
+    StatsView groupStatsView() const;           // Summed over every shard of the group
+
+    void printStatus();
+    void printStats();
+
+    int getMoveCount() const;
+    int getRequestsHandled() const;
+    double getAverageWaitSeconds() const;
+    size_t getQueuedRequests();
+    uint64_t getRejectedDatagrams() const;
+    uint64_t getRetransmits() const;
+    bool awaitingAck(int id) const;             // The car's last binary route is unacknowledged
+
+    // Zero (the default) dispatches each request greedily as it arrives; otherwise
+    // requests are collected for this long and assigned together
+    void setBatchWindow(Clock::duration window);
+    Clock::duration getBatchWindow() const;
+
+    // Collective control lets a car that is already sweeping past a hall call in
+    // the call's direction pick it up on the way; otherwise only idle cars are used
+    void setCollectiveControl(bool enabled);
+    bool getCollectiveControl() const;
+
+    // Admission control. At most 'limit' hall calls wait at once (zero for no
+    // bound); a call that finds the queue full is handled by 'policy'
+    void setQueueLimit(size_t limit, OverloadPolicy policy = OverloadPolicy::REJECT);
+    // Each sender may have 'rate' hall calls a second admitted, in bursts of up
+    // to 'burst'; the rest are NAKed. Zero, the default, admits every call.
+    void setRateLimit(double rate, double burst);
+    size_t getQueueHighWater() const;
+    uint64_t getRefusedRequests() const;
+    uint64_t getShedRequests() const;
+    bool isDegraded() const;                    // Batching because of overload
+
+    // Cars are answered in the wire format they last sent; text-only answers
+    // every car in text
+    void setTextOnly(bool enabled);
+    bool usesBinary(int id) const;
+
+    // Before start(): also take messages from a shared-memory ring and send
+    // commands through the rings of cars that offer CAP_SHM (shm_ring.h)
+    void setSharedMemory(bool enabled);
+    bool usesSharedMemory(int id) const;
+
+    // Before start(): run the socket through io_uring (uring_socket.h) instead
+    // of epoll, recvmmsg and sendmmsg; epoll stays if the kernel refuses
+    void setIoUring(bool enabled);
+
+    void refreshElevator(int id);               // Re-files and republishes a car after its state changed
+
+    // Adds a car, or resets one that restarted, growing the fleet as needed;
+    // false if the ID cannot be used
+    bool registerElevator(int id, const struct sockaddr_in& addr, uint32_t capabilities);
+    void deregisterElevator(int id);            // Hands the car's calls to others and frees its slot
+    int getRegisteredCars() const;
+    const struct sockaddr_in& elevatorAddress(int id) const;
+
+    // Public for unit testing
+    FleetTable fleet; // Floor, load, status and timestamps of every elevator
+    std::vector<StopPlan> plans; // Work still to do at each floor, per slot
+    std::vector<std::deque<int>> routes; // Itinerary last sent to each car, minus the stops it reported
+
+protected:
+    virtual void sendRoute(int elevatorID, int seen, const std::vector<int>& stops); // Queues an itinerary for an elevator
+
+    Clock& clock;
+
+private:
+    int sockfd = -1;
+    struct sockaddr_in selfAddr;
+    std::vector<struct sockaddr_in> elevatorAddrs; // Where each car listens, per slot
+    std::vector<uint32_t> capabilities;            // Capability bits from each car's HELLO, per slot
+    std::vector<std::shared_ptr<ShmRing>> carRings; // Ring a CAP_SHM car reads, per slot
+    std::map<int, std::shared_ptr<ShmRing>> ringsByPort; // Cars of one host share its ring
+    std::unique_ptr<ShmRing> shmInbox;             // Messages from peers on this host, if enabled
+    bool sharedMemory = false;
+    std::unique_ptr<UringSocket> uring;            // Replaces epoll and the mmsg calls, if enabled
+    bool ioUring = false;
+    int registeredCars = 0;                        // Slots not OFFLINE
+    std::vector<Scheduler*> shards{this};          // The group, in socket order; this one alone unless sharded
+    int shardIndex = 0;
+    int bankSize = SHARD_BANK_SIZE;
+    std::unique_ptr<MpscRing<ForwardedDatagram>> forwardRing; // Filled by the other shards, if sharded
+    int forwardFd = -1;                            // eventfd they ring after pushing
+    std::vector<OutboundCommand> outbox;           // Commands not yet flushed, in send order
+
+    std::vector<Request> inbox;         // Requests handed to the dispatch stage, at most REQUEST_INBOX_SIZE
+    std::deque<Request> requestQueue;  // Requests not yet assigned, in arrival order
+    size_t queueLimit = REQUEST_QUEUE_MAX; // Zero for unbounded
+    OverloadPolicy overloadPolicy = OverloadPolicy::REJECT;
+    double admissionRate = 0;          // Hall calls a second per sender, zero for no limit
+    double admissionBurst = 0;
+    std::unordered_map<uint64_t, TokenBucket> buckets; // Per sender address and port
+    bool degraded = false;             // DEGRADE switched on batching
+    Clock::duration configuredWindow{}; // Batch window to go back to
+    size_t queueHighWater = 0;
+    uint64_t requestsRefused = 0;
+    uint64_t requestsShed = 0;
+    bool wakeup = false;               // A request arrived or a car freed up
+    uint64_t inboxFlushes = 0;         // Times the inbox was full and emptied early
+    uint64_t datagramsReceived = 0;    // Datagrams read by drainSocket()
+    uint64_t recvCalls = 0;            // recvmmsg calls that returned data
+    std::vector<bool> binaryPeers;     // Car last spoke WIRE_VERSION binary, per slot
+    std::vector<uint32_t> sendSeq;     // Sequence number of the last command to each car
+    uint32_t schedulerEpoch;           // Random per scheduler, sent in every binary ROUTE
+    std::vector<UnackedRoute> unacked; // Per slot; a newer route replaces the one waiting
+    TimerWheel<std::pair<int, uint32_t>> retransmitWheel; // Car and route seq, per timeout
+    Clock::time_point wheelEpoch;      // Time of tick 0
+    Clock::duration srtt{};            // Smoothed ACK round trip, zero before the first sample
+    Clock::duration rttvar{};
+    Clock::duration rto;               // Current retransmit timeout
+    uint64_t retransmits = 0;          // Routes sent again for want of an ACK
+    uint64_t acksReceived = 0;
+    uint64_t routesGivenUp = 0;        // Cars failed after ROUTE_MAX_RETRIES
+    Clock::duration ackRttTotal{};     // Summed over routes acknowledged without a resend
+    Clock::duration ackRttMax{};
+    uint64_t ackRttSamples = 0;
+    uint64_t commandsSent = 0;         // Commands written by flushCommands()
+    uint64_t sendCalls = 0;            // sendmmsg calls that wrote something
+    uint64_t shmReceived = 0;
+    uint64_t shmSent = 0;
+    uint64_t epollWaits = 0;
+    uint64_t uringEnters = 0;          // io_uring_enter calls so far
+    uint64_t forwarded = 0;
+    uint64_t rejectedDatagrams = 0;    // Malformed datagrams and reports from unknown cars
+    SeqlockSlots<CarView, MAX_ELEVATORS> carViews; // Each car as of its last refreshElevator(), per slot
+    Seqlock<StatsView> stats;          // Counters as of the last refreshElevator()
+
+    IdleCarIndex idleCars; // Available cars by floor, kept in step with the fleet table
+    std::set<std::pair<Clock::time_point, int>> warnings; // Each warned car's last WARNING time, oldest first
+    Clock::time_point startTime; // Simulation start time
+
+    int moveCount = 0; // Number of itineraries sent
+    int requestsHandled = 0; //Numbver of requests handled
+    int pickups = 0; // Passengers collected from their floor
+    Clock::duration totalWait{}; // Summed time from request to pickup
+    Clock::duration batchWindow{}; // Collection window for batch dispatch, zero for greedy
+    bool collective = false; // Merge hall calls into sweeps already under way
+    bool textOnly = false; // Never answer in binary
+    int floorCount; // Top floor; floors run from 0 to here
+
+    void attachSteering();                     // Loads the shard-by-bank program into the port's socket group
+    void runEventLoop();                       // Receives, applies and dispatches on one thread
+    void drainSocket();                        // Applies every waiting datagram, RECV_BATCH at a time
+    void flushCommands();                      // Sends the outbox, SEND_BATCH at a time
+    std::shared_ptr<ShmRing> attachRing(int port); // The ring of the car host on 'port', shared by its cars
+    void applyStatus(int id, int floor);
+    void applyArrival(int id, int floor);
+    void applyPosition(int id, int floor);
+    void applyHeartbeat(int id, int floor);
+    void applyAck(int id, uint32_t seq);
+    void retransmit(int id, uint32_t seq);     // Resends the route if it is still the unacknowledged one
+    uint64_t wheelTick(Clock::time_point t) const;
+    void applyHello(int id, const Report& report, const struct sockaddr_in* from);
+    void applyFault(int id);
+    void applyWarning(int id, uint32_t flags);
+    void rejectDatagram();                     // Counts a malformed or misaddressed datagram
+    bool inBuilding(const Report& report) const; // Floors the report names lie between 0 and floorCount
+    void forward(Scheduler* to, const char* data, size_t len, const struct sockaddr_in* from);
+    void publishStats();                       // Stores the counters for the display thread
+    void notePeerFormat(int id, bool binary);  // Switches the car's reply format, resending its route
+    void resizeFleet(int count);               // Grows with OFFLINE slots or drops trailing ones
+    void assign(const Request& req, int elevatorID); // Adds the pickup to the car's plan
+    void book(const Request& req, int elevatorID);   // assign() without re-planning the route
+    bool isIdle(int slot) const;               // Available, under capacity and without stops
+    int nextStoppableFloor(int slot) const;    // Nearest floor a car on a leg can still stop at
+    long sweepCost(int slot, const Request& req) const; // Cost of joining the car's sweep, -1 if it cannot
+    void wakeDispatcher();                     // Sets 'wakeup'
+    void enqueue(const Request& req);          // Adds to the inbox and wakes dispatch
+    bool admit(const Request& req);            // Rate and queue checks; false if the call was NAKed
+    bool takeToken(const struct sockaddr_in& source, uint32_t& retryAfterMs);
+    void sendNak(const Request& req, NakReason reason, uint32_t retryAfterMs);
+    void noteQueueDepth();                     // Raises the high-water mark
+    void relieveOverload();                    // Ends degraded batching once the queue has drained
+    void collectRequests();                    // Moves the ring into requestQueue
+    void arriveAt(int elevatorID, int floor);  // Serves the stop an ARRIVED reported
+    void replan(int elevatorID);               // Sends the car its new route if the plan changed it
+    void abandonPlan(int elevatorID);          // Returns a failed car's uncollected calls to the queue
+    void displayStatusLoop();                 // Periodically displays status of elevators
+};
+
+#endif // SCHEDULER_H
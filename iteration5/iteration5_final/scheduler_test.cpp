@@ -2,79 +2,42 @@
 #include <gtest/gtest.h>
 #include <sstream>
 #include <string>
-#include <unordered_map>
-#include <chrono>
-#include <queue>
-#include <condition_variable>
-#include <mutex>
-#include <thread>
 #include <iostream>
-#include <climits>
-
-// Constants matching scheduler.cpp
-#define MAX_CAPACITY 4
-
-// Re-declare Request struct
-struct Request {
-    int floor;
-    int targetFloor;
-    std::string direction;
-    Request(int f, int t, const std::string& d) : floor(f), targetFloor(t), direction(d) {}
-};
-
-// === Minimal Scheduler declaration with virtual method ===
-class Scheduler {
-public:
-    Scheduler(int, int) {}
-    virtual ~Scheduler() {}
-    virtual void sendMoveCommand(int, int) {}
-};
+#include <random>
+#include <arpa/inet.h>
+#include <thread>
+#include "scheduler.h"
+#include "dispatch.h"
+#include "mpsc_ring.h"
+#include "seqlock.h"
+#include "shm_ring.h"
+#include "text_parser.h"
+#include "timer_wheel.h"
+#include "uring_socket.h"
+#include "wire.h"
 
 // === MockScheduler for testing ===
 class MockScheduler : public Scheduler {
 public:
     std::string capturedCommand;
-    std::unordered_map<int, int> elevatorFloors;
-    std::unordered_map<int, std::string> elevatorStatus;
-    std::queue<Request> requestQueue;
-    std::mutex queueMutex;
-    std::condition_variable cv;
+    int routesSent = 0;
 
     MockScheduler() : Scheduler(3, 10) {}
 
     void injectRequest(const Request& req) {
-        std::lock_guard<std::mutex> lock(queueMutex);
-        requestQueue.push(req);
-        cv.notify_one();
+        requeue(req);
     }
 
     void runOnce() {
-        std::unique_lock<std::mutex> lock(queueMutex);
-        if (requestQueue.empty()) return;
-
-        Request req = requestQueue.front();
-        requestQueue.pop();
-        lock.unlock();
-
-        int best = -1, minDist = INT_MAX;
-        for (int i = 1; i <= 3; ++i) {
-            if (elevatorStatus[i] != "OK") continue;
-            int dist = std::abs(elevatorFloors[i] - req.floor);
-            if (dist < minDist) {
-                minDist = dist;
-                best = i;
-            }
-        }
-
-        if (best != -1) {
-            sendMoveCommand(best, req.targetFloor);
-        }
+        Request req(0, 0, "");
+        if (!nextRequest(req)) return;
+        tryDispatch(req);
     }
 
-    void sendMoveCommand(int elevatorID, int targetFloor) override {
-        std::stringstream ss;
-        ss << "MOVE to Elevator " << elevatorID << " to Floor " << targetFloor;
-        capturedCommand = ss.str();
+protected:
+    void sendRoute(int elevatorID, int seen, const std::vector<int>& stops) override {
+        capturedCommand = formatRoute(elevatorID, seen, stops);
+        routesSent++;
         std::cout << "[MOCK] " << capturedCommand << std::endl;
     }
 };
@@ -82,18 +45,850 @@ public:
 // === Unit Test ===
 TEST(SchedulerTest, AssignsClosestElevator) {
     MockScheduler scheduler;
-    scheduler.elevatorFloors[1] = 0;
-    scheduler.elevatorFloors[2] = 4;
-    scheduler.elevatorFloors[3] = 2;
+    scheduler.fleet.floorOf(1) = 0;
+    scheduler.fleet.floorOf(2) = 4;
+    scheduler.fleet.floorOf(3) = 2;
 
-    scheduler.elevatorStatus[1] = "OK";
-    scheduler.elevatorStatus[2] = "OK";
-    scheduler.elevatorStatus[3] = "OK";
+    scheduler.fleet.statusOf(1) = ElevatorState::OK;
+    scheduler.fleet.statusOf(2) = ElevatorState::OK;
+    scheduler.fleet.statusOf(3) = ElevatorState::OK;
+    for (int i = 1; i <= 3; ++i) scheduler.refreshElevator(i);
 
     scheduler.injectRequest(Request(3, 7, "UP"));
     scheduler.runOnce();
 
-    EXPECT_NE(scheduler.capturedCommand.find("MOVE to Elevator 2 to Floor 7"), std::string::npos);
+    // Collect the passenger first, then take them to their floor
+    EXPECT_EQ(scheduler.capturedCommand, "ROUTE 2 0 3 7");
+}
+
+TEST(SchedulerTest, WarningUsesInjectedClock) {
+    VirtualClock clock;
+    Scheduler scheduler(1, 10, clock);
+
+    scheduler.handleMessage("WARNING 1 DOOR_STUCK");
+    scheduler.handleMessage("STATUS 1 3");
+    EXPECT_EQ(scheduler.fleet.statusOf(1), ElevatorState::WARNING);
+    EXPECT_EQ(scheduler.fleet.statusTextOf(1), "WARNING(DOOR_STUCK)");
+
+    clock.sleepFor(std::chrono::seconds(6));
+    scheduler.handleMessage("STATUS 1 4");
+    EXPECT_EQ(scheduler.fleet.statusOf(1), ElevatorState::REACHED);
+    EXPECT_EQ(scheduler.fleet.warningsOf(1), WARN_NONE);
+}
+
+TEST(SchedulerTest, WarningExpiresWithoutFurtherStatus) {
+    VirtualClock clock;
+    Scheduler scheduler(1, 10, clock);
+    scheduler.handleMessage("WARNING 1 DOOR_STUCK");
+    scheduler.handleMessage("STATUS 1 3");
+    EXPECT_FALSE(scheduler.tryDispatch(Request(2, 5, "UP")));
+
+    clock.sleepFor(std::chrono::seconds(WARNING_HOLD_S + 1));
+    EXPECT_TRUE(scheduler.tryDispatch(Request(2, 5, "UP")));
+    EXPECT_EQ(scheduler.fleet.statusOf(1), ElevatorState::MOVING);
+}
+
+TEST(SchedulerTest, RepeatedWarningMovesTheExpiry) {
+    VirtualClock clock;
+    Scheduler scheduler(1, 10, clock);
+    scheduler.handleMessage("STATUS 1 3");
+    scheduler.handleMessage("WARNING 1 DOOR_STUCK");
+    clock.sleepFor(std::chrono::seconds(3));
+    for (int i = 0; i < 100; ++i) scheduler.handleMessage("WARNING 1 DOOR_STUCK");
+    EXPECT_EQ(scheduler.nextWarningExpiry(), clock.now() + std::chrono::seconds(WARNING_HOLD_S + 1));
+
+    clock.sleepFor(std::chrono::seconds(WARNING_HOLD_S - 2));
+    EXPECT_FALSE(scheduler.tryDispatch(Request(2, 5, "UP"))); // Held from the last warning, not the first
+    clock.sleepFor(std::chrono::seconds(3));
+    EXPECT_TRUE(scheduler.tryDispatch(Request(2, 5, "UP")));
+    EXPECT_EQ(scheduler.nextWarningExpiry(), Clock::time_point::max());
+}
+
+TEST(SchedulerTest, FleetTableScalesToThousandsOfCars) {
+    Scheduler scheduler(5000, 100);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(scheduler.fleet.floor.data()) % CACHE_LINE, 0u);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(scheduler.fleet.load.data()) % CACHE_LINE, 0u);
+
+    scheduler.handleMessage("STATUS 4321 50");
+    scheduler.handleMessage("STATUS 9999 49"); // Unknown elevator, ignored
+    EXPECT_EQ(scheduler.findBestElevator(Request(48, 1, "DOWN")), 4321);
+}
+
+TEST(SchedulerTest, VectorKernelMatchesScalarTieBreaking) {
+    // Few distinct floors so most queries have several equally close cars
+    std::mt19937 rng(7);
+    FleetTable fleet(1003);
+    for (int i = 0; i < fleet.size(); ++i) {
+        fleet.floor[i] = rng() % 6;
+        fleet.load[i] = rng() % (MAX_CAPACITY + 1);
+        fleet.status[i] = ElevatorState(rng() % 5);
+    }
+    const int32_t* status = reinterpret_cast<const int32_t*>(fleet.status.data());
+    for (int n : {0, 5, 8, 17, 1003}) {
+        for (int q = -1; q <= 7; ++q) {
+            int expected = nearestAvailableScalar(fleet.floor.data(), fleet.load.data(), status, n, q, MAX_CAPACITY);
+            EXPECT_EQ(nearestAvailableAvx2(fleet.floor.data(), fleet.load.data(), status, n, q, MAX_CAPACITY), expected);
+        }
+    }
+}
+
+TEST(SchedulerTest, IdleIndexMatchesFleetScan) {
+    // Random STATUS/FAULT/WARNING/dispatch traffic over a tall building
+    VirtualClock clock;
+    Scheduler scheduler(300, 5000, clock);
+    std::mt19937 rng(11);
+    char msg[64];
+    for (int round = 0; round < 3000; ++round) {
+        int id = 1 + rng() % 300;
+        switch (rng() % 4) {
+        case 0: snprintf(msg, sizeof(msg), "STATUS %d %d", id, (int)(rng() % 5001)); break;
+        case 1: snprintf(msg, sizeof(msg), "FAULT %d", id); break;
+        case 2: snprintf(msg, sizeof(msg), "WARNING %d DOOR_STUCK", id); break;
+        default: scheduler.tryDispatch(Request(rng() % 5000, 0, "UP")); continue;
+        }
+        scheduler.handleMessage(msg);
+        clock.sleepFor(std::chrono::milliseconds(rng() % 4000));
+
+        int reqFloor = (int)(rng() % 5100) - 50;
+        int expected = nearestAvailableScalar(scheduler.fleet.floor.data(), scheduler.fleet.load.data(),
+                                              reinterpret_cast<const int32_t*>(scheduler.fleet.status.data()),
+                                              scheduler.fleet.size(), reqFloor, MAX_CAPACITY);
+        ASSERT_EQ(scheduler.findBestElevator(Request(reqFloor, 0, "UP")), expected < 0 ? -1 : expected + 1);
+    }
+
+    // The index covers the building and nothing else, however far off a car claims to be
+    IdleCarIndex index;
+    index.setFloors(10);
+    index.resize(2);
+    index.update(0, 2000000000, true);
+    index.update(1, -1, true);
+    EXPECT_FALSE(index.contains(0));
+    EXPECT_FALSE(index.contains(1));
+    EXPECT_EQ(index.nearest(5), -1);
+    index.update(0, 10, true);
+    EXPECT_EQ(index.nearest(2000000000), 0);
+}
+
+TEST(SchedulerTest, SolveAssignmentFindsMinimumCost) {
+    std::vector<std::vector<long>> cost = {{4, 1, 3}, {2, 0, 5}};
+    std::vector<int> assignment = solveAssignment(cost);
+    ASSERT_EQ(assignment.size(), 2u);
+    EXPECT_EQ(cost[0][assignment[0]] + cost[1][assignment[1]], 3);
+    EXPECT_NE(assignment[0], assignment[1]);
+}
+
+TEST(SchedulerTest, BatchAssignsBetterThanGreedy) {
+    // Car 1 waits at floor 5, car 2 at floor 0; calls arrive from floors 4, 6 and 1.
+    // Greedy sends car 1 to the first call and car 2 up six floors, leaving the
+    // third call queued; the batch lets car 1 collect both calls near it
+    // (one extra stop) and sends car 2 to floor 1
+    MockScheduler scheduler;
+    scheduler.handleMessage("STATUS 1 5");
+    scheduler.handleMessage("STATUS 2 0");
+    scheduler.handleMessage("FAULT 3");
+    scheduler.injectRequest(Request(4, 9, "UP"));
+    scheduler.injectRequest(Request(6, 8, "UP"));
+    scheduler.injectRequest(Request(1, 2, "UP"));
+
+    std::vector<Request> batch = scheduler.drainRequests();
+    EXPECT_EQ(scheduler.dispatchBatch(batch), 3);
+    EXPECT_TRUE(batch.empty());
+    EXPECT_EQ(scheduler.fleet.loadOf(1), 2);
+    EXPECT_EQ(scheduler.fleet.loadOf(2), 1);
+    EXPECT_EQ(scheduler.capturedCommand, "ROUTE 2 0 1 2");
+}
+
+TEST(SchedulerTest, BatchFillsSpareSeats) {
+    // One car in service: two calls share it, and calls beyond its free seats
+    // stay queued in arrival order
+    MockScheduler scheduler;
+    scheduler.handleMessage("STATUS 1 0");
+    scheduler.handleMessage("FAULT 2");
+    scheduler.handleMessage("FAULT 3");
+    scheduler.injectRequest(Request(3, 7, "UP"));
+    scheduler.injectRequest(Request(5, 9, "UP"));
+    std::vector<Request> batch = scheduler.drainRequests();
+    EXPECT_EQ(scheduler.dispatchBatch(batch), 2);
+    EXPECT_TRUE(batch.empty());
+    EXPECT_EQ(scheduler.fleet.loadOf(1), 2);
+    EXPECT_EQ(scheduler.capturedCommand, "ROUTE 1 0 3 5 7 9");
+    EXPECT_EQ(scheduler.routesSent, 1); // One route for both calls
+
+    MockScheduler full;
+    full.handleMessage("STATUS 1 0");
+    full.handleMessage("FAULT 2");
+    full.handleMessage("FAULT 3");
+    for (int floor = 1; floor <= MAX_CAPACITY + 1; ++floor) full.injectRequest(Request(floor, 10, "UP"));
+    batch = full.drainRequests();
+    EXPECT_EQ(full.dispatchBatch(batch), MAX_CAPACITY);
+    ASSERT_EQ(batch.size(), 1u);
+    EXPECT_EQ(batch[0].floor, MAX_CAPACITY + 1);
+    EXPECT_EQ(full.fleet.loadOf(1), MAX_CAPACITY);
+}
+
+TEST(SchedulerTest, CollectiveMergesCallsAheadOfSweep) {
+    // Car 1 collects a passenger at floor 4 and heads up to 6; car 2 idles at 10
+    MockScheduler scheduler;
+    scheduler.setCollectiveControl(true);
+    scheduler.handleMessage("STATUS 1 4");
+    scheduler.handleMessage("STATUS 2 10");
+    scheduler.handleMessage("FAULT 3");
+    ASSERT_TRUE(scheduler.tryDispatch(Request(4, 6, "UP")));
+    EXPECT_EQ(scheduler.capturedCommand, "ROUTE 1 0 4 6");
+    scheduler.handleMessage("ARRIVED 1 4");
+    EXPECT_EQ(scheduler.fleet.directionOf(1), Direction::UP);
+    EXPECT_EQ(scheduler.fleet.legTargetOf(1), 6);
+
+    // Floor 6 UP is where car 1 stops anyway
+    EXPECT_EQ(scheduler.findCollectiveElevator(Request(6, 8, "UP")), 1);
+    // Floor 7 UP is on car 1's sweep, but the stop at 6 makes car 2 cheaper
+    EXPECT_EQ(scheduler.findCollectiveElevator(Request(7, 8, "UP")), 2);
+    // Behind the sweep or against its direction only the idle car qualifies
+    EXPECT_EQ(scheduler.findCollectiveElevator(Request(3, 8, "UP")), 2);
+    EXPECT_EQ(scheduler.findCollectiveElevator(Request(6, 2, "DOWN")), 2);
+
+    // Without collective control the sweeping car is never considered
+    scheduler.handleMessage("FAULT 2");
+    scheduler.setCollectiveControl(false);
+    EXPECT_FALSE(scheduler.tryDispatch(Request(6, 8, "UP")));
+    scheduler.setCollectiveControl(true);
+    ASSERT_TRUE(scheduler.tryDispatch(Request(6, 8, "UP")));
+    EXPECT_EQ(scheduler.capturedCommand, "ROUTE 1 1 6 8");
+    EXPECT_EQ(scheduler.fleet.loadOf(1), 2);
+
+    // At floor 6 the first passenger leaves and the second boards for floor 8
+    scheduler.handleMessage("ARRIVED 1 6");
+    EXPECT_EQ(scheduler.fleet.loadOf(1), 1);
+    scheduler.handleMessage("ARRIVED 1 8");
+    scheduler.handleMessage("STATUS 1 8");
+    EXPECT_EQ(scheduler.fleet.loadOf(1), 0);
+    EXPECT_EQ(scheduler.fleet.statusOf(1), ElevatorState::REACHED);
+    EXPECT_EQ(scheduler.fleet.directionOf(1), Direction::IDLE);
+    EXPECT_EQ(scheduler.getMoveCount(), 2);
+}
+
+TEST(SchedulerTest, RouteSlotsMergedCallsBetweenStops) {
+    MockScheduler scheduler;
+    scheduler.setCollectiveControl(true);
+    scheduler.handleMessage("FAULT 2");
+    scheduler.handleMessage("FAULT 3");
+    ASSERT_TRUE(scheduler.tryDispatch(Request(3, 7, "UP")));
+    EXPECT_EQ(scheduler.capturedCommand, "ROUTE 1 0 3 7");
+
+    // Picked up at 5 and dropped at 6, both before the first passenger's floor
+    ASSERT_TRUE(scheduler.tryDispatch(Request(5, 6, "UP")));
+    EXPECT_EQ(scheduler.capturedCommand, "ROUTE 1 0 3 5 6 7");
+    // A call against the sweep is not merged
+    EXPECT_FALSE(scheduler.tryDispatch(Request(8, 4, "DOWN")));
+    ASSERT_TRUE(scheduler.tryDispatch(Request(8, 9, "UP")));
+    EXPECT_EQ(scheduler.capturedCommand, "ROUTE 1 0 3 5 6 7 8 9");
+
+    scheduler.handleMessage("ARRIVED 1 3");
+    scheduler.handleMessage("ARRIVED 1 5");
+    EXPECT_EQ(scheduler.fleet.loadOf(1), 3);
+    EXPECT_EQ(scheduler.planRoute(1), std::vector<int>({6, 7, 8, 9}));
+}
+
+TEST(SchedulerTest, MovingCarTakesCallsItHasNotPassed) {
+    MockScheduler scheduler;
+    scheduler.setCollectiveControl(true);
+    scheduler.handleMessage("FAULT 2");
+    scheduler.handleMessage("FAULT 3");
+    ASSERT_TRUE(scheduler.tryDispatch(Request(0, 8, "UP")));
+    scheduler.handleMessage("ARRIVED 1 0");
+    scheduler.handleMessage("POSITION 1 2");
+    EXPECT_EQ(scheduler.fleet.floorOf(1), 2);
+    EXPECT_EQ(scheduler.fleet.statusOf(1), ElevatorState::MOVING);
+
+    // Floor 3 is the next floor the car can stop at, so the call cuts the leg short
+    ASSERT_TRUE(scheduler.tryDispatch(Request(3, 5, "UP")));
+    EXPECT_EQ(scheduler.capturedCommand, "ROUTE 1 1 3 5 8");
+
+    // Past floor 3 the car may already be passing 4 on its way to 5
+    scheduler.handleMessage("ARRIVED 1 3");
+    scheduler.handleMessage("POSITION 1 4");
+    EXPECT_FALSE(scheduler.tryDispatch(Request(4, 6, "UP")));
+    ASSERT_TRUE(scheduler.tryDispatch(Request(5, 6, "UP")));
+    EXPECT_EQ(scheduler.capturedCommand, "ROUTE 1 2 5 6 8");
+}
+
+TEST(SchedulerTest, HeartbeatRepairsLostStatus) {
+    MockScheduler scheduler;
+    scheduler.handleMessage("STATUS 1 3");
+    scheduler.handleMessage("HEARTBEAT 1 3");
+    EXPECT_EQ(scheduler.fleet.floorOf(1), 3);
+
+    // The STATUS for floor 5 never arrived
+    scheduler.handleMessage("HEARTBEAT 1 5");
+    EXPECT_EQ(scheduler.fleet.floorOf(1), 5);
+    EXPECT_EQ(scheduler.fleet.statusOf(1), ElevatorState::REACHED);
+
+    // A car with a route in flight has not started it yet, so it is left alone
+    ASSERT_TRUE(scheduler.tryDispatch(Request(8, 9, "UP")));
+    scheduler.handleMessage("HEARTBEAT 1 4");
+    EXPECT_EQ(scheduler.fleet.floorOf(1), 5);
+}
+
+TEST(SchedulerTest, PendingRequestsWaitForAFreeCar) {
+    MockScheduler scheduler;
+    scheduler.handleMessage("FAULT 2");
+    scheduler.handleMessage("FAULT 3");
+    scheduler.handleMessage("2 UP 5");
+    scheduler.handleMessage("4 DOWN 1");
+    scheduler.handleMessage("6 UP 9");
+    EXPECT_TRUE(scheduler.consumeWakeup());
+    EXPECT_EQ(scheduler.dispatchPending(), 1);
+    EXPECT_EQ(scheduler.capturedCommand, "ROUTE 1 0 2 5");
+
+    // Nothing changed, so nothing wakes the dispatcher
+    EXPECT_FALSE(scheduler.consumeWakeup());
+    scheduler.handleMessage("ARRIVED 1 2");
+    EXPECT_FALSE(scheduler.consumeWakeup());
+
+    // The car finishing its route does, and the older request goes first
+    scheduler.handleMessage("ARRIVED 1 5");
+    scheduler.handleMessage("STATUS 1 5");
+    EXPECT_TRUE(scheduler.consumeWakeup());
+    EXPECT_EQ(scheduler.dispatchPending(), 1);
+    EXPECT_EQ(scheduler.capturedCommand, "ROUTE 1 2 4 1");
+    EXPECT_EQ(scheduler.getQueuedRequests(), 1u);
+}
+
+TEST(SchedulerTest, RestoredRequestsKeepArrivalOrder) {
+    MockScheduler scheduler;
+    auto at = [](int s) { return Clock::time_point{} + std::chrono::seconds(s); };
+    scheduler.requeue(Request(5, 0, "DOWN", at(5)));
+    scheduler.requeue(Request(9, 0, "DOWN", at(9)));
+    scheduler.restoreRequests({Request(3, 0, "DOWN", at(3)), Request(7, 0, "DOWN", at(7))});
+
+    std::vector<int> order;
+    for (const Request& req : scheduler.drainRequests()) order.push_back(req.floor);
+    EXPECT_EQ(order, std::vector<int>({3, 5, 7, 9}));
+}
+
+TEST(SchedulerTest, FaultReturnsUncollectedCalls) {
+    MockScheduler scheduler;
+    ASSERT_TRUE(scheduler.tryDispatch(Request(5, 9, "UP")));
+    ASSERT_TRUE(scheduler.tryDispatch(Request(2, 3, "UP")));
+    scheduler.handleMessage("FAULT 1");
+    EXPECT_EQ(scheduler.fleet.loadOf(1), 0);
+    EXPECT_EQ(scheduler.getQueuedRequests(), 1u);
+}
+
+TEST(SchedulerTest, RingDeliversEveryPushOnceInProducerOrder) {
+    MpscRing<int> full(3);
+    EXPECT_EQ(full.capacity(), 4u);
+    for (int i = 0; i < 4; ++i) EXPECT_TRUE(full.tryPush(i));
+    EXPECT_FALSE(full.tryPush(4));
+    int value;
+    ASSERT_TRUE(full.tryPop(value));
+    EXPECT_EQ(value, 0);
+    EXPECT_TRUE(full.tryPush(4));
+
+    // Four producers through a small ring, so they keep wrapping and filling it
+    const int producers = 4, perProducer = 20000;
+    MpscRing<int> ring(64);
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; ++p) {
+        threads.emplace_back([&ring, p] {
+            for (int i = 0; i < perProducer; ++i) {
+                while (!ring.tryPush(p * perProducer + i)) std::this_thread::yield();
+            }
+        });
+    }
+    std::vector<int> next(producers, 0);
+    for (int received = 0; received < producers * perProducer;) {
+        if (!ring.tryPop(value)) {
+            std::this_thread::yield();
+            continue;
+        }
+        int p = value / perProducer;
+        ASSERT_EQ(value % perProducer, next[p]++);
+        received++;
+    }
+    for (std::thread& t : threads) t.join();
+    EXPECT_TRUE(ring.empty());
+}
+
+TEST(SchedulerTest, SnapshotReadersNeverSeeHalfAnUpdate) {
+    // The writer keeps floor and load equal; a torn read would show them apart
+    Seqlock<CarView> slot;
+    std::atomic<bool> done{false};
+    std::thread writer([&] {
+        for (int32_t i = 1; i <= 200000; ++i) slot.store({i, i, ElevatorState::MOVING, WARN_NONE});
+        done.store(true);
+    });
+    int32_t last = 0;
+    while (!done.load()) {
+        CarView car = slot.load();
+        ASSERT_EQ(car.floor, car.load);
+        ASSERT_GE(car.floor, last); // Never goes back to an older version
+        last = car.floor;
+    }
+    writer.join();
+    EXPECT_EQ(slot.load().floor, 200000);
+
+    MockScheduler scheduler;
+    scheduler.handleMessage("STATUS 2 7");
+    scheduler.handleMessage("WARNING 1 DOOR_STUCK");
+    EXPECT_EQ(scheduler.carView(2).floor, 7);
+    EXPECT_EQ(scheduler.carView(2).status, ElevatorState::REACHED);
+    EXPECT_EQ(scheduler.carView(1).status, ElevatorState::WARNING);
+    EXPECT_EQ(scheduler.carView(1).warnings, WARN_DOOR_STUCK);
+    scheduler.handleMessage("6 UP 8");
+    scheduler.dispatchPending();
+    EXPECT_EQ(scheduler.carView(2).load, 1);
+    EXPECT_EQ(scheduler.statsView().requestsHandled, 1);
+    EXPECT_EQ(scheduler.statsView().moveCount, 1);
+}
+
+TEST(SchedulerTest, BinaryMessagesNegotiateReplyFormat) {
+    MockScheduler scheduler;
+    char msg[64];
+    size_t len = putWire(msg, 0, wireHeader(MsgType::STATUS, 2, 1, Clock::time_point{}, 6));
+    scheduler.handleDatagram(msg, len);
+    EXPECT_EQ(scheduler.fleet.floorOf(2), 6);
+    EXPECT_TRUE(scheduler.usesBinary(2));
+    EXPECT_FALSE(scheduler.usesBinary(1)); // Never heard from
+
+    // Binary request from a client: 5 DOWN to 1
+    len = putWire(msg, 0, wireHeader(MsgType::REQUEST, 0, 1, Clock::time_point{}, 5, 1));
+    len = putWire(msg, len, (int16_t)1);
+    scheduler.handleDatagram(msg, len - 1); // Truncated: ignored
+    scheduler.handleDatagram(msg, len);
+    scheduler.dispatchPending();
+    EXPECT_EQ(scheduler.capturedCommand, "ROUTE 2 0 5 1");
+
+    len = putWire(msg, 0, wireHeader(MsgType::WARNING, 1, 2, Clock::time_point{}, 0));
+    len = putWire(msg, len, (uint32_t)WARN_DOOR_STUCK);
+    scheduler.handleDatagram(msg, len);
+    EXPECT_EQ(scheduler.fleet.statusTextOf(1), "WARNING(DOOR_STUCK)");
+
+    // A car speaking another version falls back to text and gets its route again
+    scheduler.capturedCommand.clear();
+    WireHeader future = wireHeader(MsgType::STATUS, 2, 3, Clock::time_point{}, 6);
+    future.version = WIRE_VERSION + 1;
+    len = putWire(msg, 0, future);
+    scheduler.handleDatagram(msg, len);
+    EXPECT_FALSE(scheduler.usesBinary(2));
+    EXPECT_EQ(scheduler.capturedCommand, "ROUTE 2 0 5 1");
+
+    // Binary ROUTE layout: header, <seen>, epoch, stops
+    std::string route = scheduler.encodeRoute(3, 9, 4, {7, 2});
+    WireHeader header;
+    ASSERT_TRUE(readWireHeader(route.data(), route.size(), header));
+    EXPECT_EQ(route.size(), 28u);
+    EXPECT_EQ(header.type, MsgType::ROUTE);
+    EXPECT_EQ(header.elevatorID, 3);
+    EXPECT_EQ(header.seq, 9u);
+    EXPECT_EQ(header.aux, 2);
+    // Little-endian whatever the host
+    EXPECT_EQ(route.substr(4, 2), std::string("\x03\x00", 2));
+    EXPECT_EQ(route.substr(8, 4), std::string("\x09\x00\x00\x00", 4));
+    EXPECT_EQ(getWire<uint32_t>(route.data(), 16), 4u);
+    EXPECT_EQ(getWire<uint32_t>(route.data(), 20), getWire<uint32_t>(scheduler.encodeRoute(1, 1, 0, {}).data(), 20));
+    EXPECT_EQ(getWire<int16_t>(route.data(), 24), 7);
+    EXPECT_EQ(getWire<int16_t>(route.data(), 26), 2);
+}
+
+TEST(SchedulerTest, RejectsMalformedDatagrams) {
+    MockScheduler scheduler;
+    const char* junk[] = {"", "STATUS", "STATUS 1", "STATUS x 3", "STATUS 1 3 4", "STATUS 1 99999999999",
+                          "ARRIVED 2", "FAULT", "FAULT 1x", "WARNING 1", "3 SIDEWAYS 4", "3 UP", "UP 3 4",
+                          "3 UP 4 5", "STATUS 9 3", "FAULT 0", "\xE7\x01\x01",
+                          // Floors past int16 would be truncated on the wire
+                          "5 UP 40000", "40000 DOWN 5", "STATUS 1 -40000", "HELLO 1 32768 0.0.0.0 9000 0",
+                          // Floors outside the building (floors 0 to 10)
+                          "STATUS 2 2000000000", "ARRIVED 1 11", "POSITION 1 -1", "HEARTBEAT 2 12",
+                          "HELLO 1 11 0.0.0.0 9000 0", "5 UP 11", "-1 UP 5"};
+    for (const char* msg : junk) scheduler.handleMessage(msg);
+    EXPECT_EQ(scheduler.getRejectedDatagrams(), sizeof(junk) / sizeof(junk[0]));
+
+    // Too long to be any valid message: rejected without being scanned
+    std::string flood(BUFFER_SIZE - 1, '7');
+    scheduler.handleDatagram(flood.data(), flood.size());
+    // Binary with a tag the scheduler does not take
+    char msg[64];
+    size_t len = putWire(msg, 0, wireHeader(MsgType::ROUTE, 1, 1, Clock::time_point{}, 0, 0));
+    len = putWire(msg, len, (uint32_t)0);
+    len = putWire(msg, len, (uint32_t)0);
+    scheduler.handleDatagram(msg, len);
+    // Binary reports and calls take the same floor checks
+    len = putWire(msg, 0, wireHeader(MsgType::STATUS, 2, 1, Clock::time_point{}, 30000));
+    scheduler.handleDatagram(msg, len);
+    len = putWire(msg, 0, wireHeader(MsgType::REQUEST, 0, 1, Clock::time_point{}, 3));
+    len = putWire(msg, len, (int16_t)-7);
+    scheduler.handleDatagram(msg, len);
+    EXPECT_EQ(scheduler.getRejectedDatagrams(), sizeof(junk) / sizeof(junk[0]) + 4);
+    std::minstd_rand rng(3);
+    for (int i = 0; i < 10000; ++i) {
+        char noise[32];
+        for (char& c : noise) c = (char)rng();
+        scheduler.handleDatagram(noise, rng() % sizeof(noise));
+    }
+    EXPECT_EQ(scheduler.fleet.statusOf(1), ElevatorState::OK);
+    EXPECT_EQ(scheduler.fleet.floorOf(2), 0);
+    EXPECT_EQ(scheduler.getQueuedRequests(), 0u);
+
+    // Still serving; separators may be any whitespace
+    scheduler.handleMessage("STATUS 2 6\n");
+    scheduler.handleMessage("5\tDOWN  1");
+    scheduler.dispatchPending();
+    EXPECT_EQ(scheduler.capturedCommand, "ROUTE 2 0 5 1");
+}
+
+TEST(SchedulerTest, TimerWheelFiresInTickOrder) {
+    TimerWheel<int> wheel;
+    for (uint64_t tick : {300000ull, 70ull, 5ull, 5000ull, 64ull, 5ull}) wheel.schedule(tick, (int)tick);
+    wheel.schedule(0, 1); // Already due
+    EXPECT_EQ(wheel.size(), 7u);
+    EXPECT_EQ(wheel.nextTick(), 1u);
+
+    std::vector<int> fired;
+    auto record = [&](int v) { fired.push_back(v); };
+    wheel.advance(63, record);
+    EXPECT_EQ(fired, std::vector<int>({1, 5, 5}));
+    EXPECT_EQ(wheel.nextTick(), 64u);
+    wheel.advance(100000, record);
+    EXPECT_EQ(fired, std::vector<int>({1, 5, 5, 64, 70, 5000}));
+    wheel.advance(299999, record);
+    EXPECT_EQ(fired.size(), 6u);
+    wheel.advance(300000, record);
+    EXPECT_EQ(fired.back(), 300000);
+    EXPECT_EQ(wheel.size(), 0u);
+    EXPECT_EQ(wheel.nextTick(), TimerWheel<int>::NONE);
+}
+
+TEST(SchedulerTest, RetransmitsRoutesUntilAcknowledged) {
+    VirtualClock clock;
+    Scheduler scheduler(2, 10, clock); // Sequence numbers start at 1
+    char msg[64];
+    auto ack = [&](int id, uint32_t seq) {
+        size_t len = putWire(msg, 0, wireHeader(MsgType::ACK, id, 0, clock.now(), 0));
+        len = putWire(msg, len, seq);
+        scheduler.handleDatagram(msg, len);
+    };
+    auto runFor = [&](int ms) {
+        for (int t = 0; t < ms; t += RETRANSMIT_TICK_MS) {
+            clock.sleepFor(std::chrono::milliseconds(RETRANSMIT_TICK_MS));
+            scheduler.handleRetransmits();
+        }
+    };
+    for (int id = 1; id <= 2; ++id) {
+        size_t len = putWire(msg, 0, wireHeader(MsgType::STATUS, id, 1, clock.now(), 0));
+        scheduler.handleDatagram(msg, len);
+    }
+    scheduler.handleMessage("0 UP 5");
+    scheduler.dispatchPending();
+    EXPECT_TRUE(scheduler.awaitingAck(1));
+    EXPECT_EQ(scheduler.nextRetransmit(), clock.now() + std::chrono::milliseconds(ROUTE_RTO_INITIAL_MS));
+
+    // Lost once, then acknowledged; an ACK for another route changes nothing
+    runFor(ROUTE_RTO_INITIAL_MS);
+    EXPECT_EQ(scheduler.getRetransmits(), 1u);
+    ack(1, 7);
+    EXPECT_TRUE(scheduler.awaitingAck(1));
+    ack(1, 1);
+    EXPECT_FALSE(scheduler.awaitingAck(1));
+    runFor(5000);
+    EXPECT_EQ(scheduler.getRetransmits(), 1u);
+
+    for (int floor : {0, 5}) {
+        size_t len = putWire(msg, 0, wireHeader(MsgType::ARRIVED, 1, 2, clock.now(), floor));
+        scheduler.handleDatagram(msg, len);
+    }
+    size_t len = putWire(msg, 0, wireHeader(MsgType::STATUS, 1, 3, clock.now(), 5));
+    scheduler.handleDatagram(msg, len);
+
+    // A car that never answers is given up on, after backing off to
+    // ROUTE_RTO_MAX_MS, and its call goes to the other car
+    scheduler.handleMessage("9 DOWN 0");
+    scheduler.dispatchPending();
+    ASSERT_TRUE(scheduler.awaitingAck(1));
+    testing::internal::CaptureStderr();
+    runFor(200 + 400 + 800 + 1600 + 3 * ROUTE_RTO_MAX_MS);
+    testing::internal::GetCapturedStderr();
+    scheduler.dispatchPending();
+    EXPECT_EQ(scheduler.getRetransmits(), 1u + ROUTE_MAX_RETRIES);
+    EXPECT_EQ(scheduler.fleet.statusOf(1), ElevatorState::FAULT);
+    EXPECT_FALSE(scheduler.awaitingAck(1));
+    EXPECT_TRUE(scheduler.awaitingAck(2));
+
+    // Heard from again: back in service
+    len = putWire(msg, 0, wireHeader(MsgType::HEARTBEAT, 1, 9, clock.now(), 5));
+    scheduler.handleDatagram(msg, len);
+    EXPECT_EQ(scheduler.fleet.statusOf(1), ElevatorState::REACHED);
+}
+
+TEST(SchedulerTest, CarsRegisterAndLeaveAtRuntime) {
+    VirtualClock clock;
+    Scheduler scheduler(0, 10, clock);
+    testing::internal::CaptureStdout();
+    scheduler.handleMessage("STATUS 1 0"); // Not registered
+    EXPECT_EQ(scheduler.getRejectedDatagrams(), 1u);
+
+    // A binary HELLO without an address is answered where it came from
+    char msg[64];
+    size_t len = putWire(msg, 0, wireHeader(MsgType::HELLO, 3, 1, clock.now(), 4));
+    len = putWire(msg, len, (uint32_t)CAP_ROUTE_ACK);
+    len = putWire(msg, len, (uint32_t)0);
+    len = putWire(msg, len, (uint16_t)6003);
+    struct sockaddr_in from = {};
+    from.sin_family = AF_INET;
+    inet_pton(AF_INET, "10.0.0.7", &from.sin_addr);
+    scheduler.handleDatagram(msg, len, &from);
+    EXPECT_EQ(scheduler.fleet.size(), 3);
+    EXPECT_EQ(scheduler.getRegisteredCars(), 1);
+    EXPECT_EQ(scheduler.fleet.statusOf(1), ElevatorState::OFFLINE);
+    EXPECT_EQ(scheduler.fleet.floorOf(3), 4);
+    EXPECT_EQ(ntohs(scheduler.elevatorAddress(3).sin_port), 6003);
+    EXPECT_EQ(scheduler.elevatorAddress(3).sin_addr.s_addr, from.sin_addr.s_addr);
+    EXPECT_TRUE(scheduler.usesBinary(3));
+
+    // Text HELLO with an address; the slots in between are never dispatched to
+    scheduler.handleMessage("HELLO 5 0 192.168.1.20 7000 0");
+    EXPECT_EQ(scheduler.fleet.size(), 5);
+    EXPECT_EQ(scheduler.elevatorAddress(5).sin_addr.s_addr, inet_addr("192.168.1.20"));
+    scheduler.handleMessage("1 UP 2");
+    scheduler.dispatchPending();
+    EXPECT_EQ(scheduler.fleet.loadOf(5), 1);
+
+    // The call of a car that leaves goes to another, and trailing slots are given back
+    scheduler.handleMessage("BYE 5");
+    EXPECT_EQ(scheduler.fleet.size(), 3);
+    EXPECT_EQ(scheduler.getRegisteredCars(), 1);
+    scheduler.dispatchPending();
+    EXPECT_EQ(scheduler.fleet.loadOf(3), 1);
+
+    // A second HELLO means the car restarted: its call is queued again
+    scheduler.handleDatagram(msg, len, &from);
+    EXPECT_EQ(scheduler.fleet.loadOf(3), 0);
+    EXPECT_EQ(scheduler.getQueuedRequests(), 1u);
+
+    const char* junk[] = {"HELLO 6 0 1.2.3 7000 0", "HELLO 6 0 1.2.3.4 70000 0", "HELLO 0 0 1.2.3.4 7000 0",
+                          "HELLO 6 0 1.2.3.4 0 1", "HELLO 70000 0 1.2.3.4 7000 1", "BYE 2"};
+    for (const char* bad : junk) scheduler.handleMessage(bad);
+    EXPECT_EQ(scheduler.getRejectedDatagrams(), 1u + sizeof(junk) / sizeof(junk[0]));
+    scheduler.handleMessage("BYE 3");
+    testing::internal::GetCapturedStdout();
+    EXPECT_EQ(scheduler.fleet.size(), 0);
+    EXPECT_EQ(scheduler.getRegisteredCars(), 0);
+}
+
+TEST(SchedulerTest, SharedMemoryRingCarriesMessagesBetweenProcesses) {
+    const int port = 59123; // Any port no test binds
+    std::unique_ptr<ShmRing> consumer = ShmRing::create(port);
+    ASSERT_NE(consumer, nullptr);
+    std::unique_ptr<ShmRing> producer = ShmRing::attach(port); // A second mapping, as another process has
+    ASSERT_NE(producer, nullptr);
+
+    // Messages come out in order, and only a sleeping consumer asks for a doorbell, once
+    EXPECT_TRUE(producer->push("ROUTE 1", 7));
+    EXPECT_FALSE(producer->takeDoorbell());
+    EXPECT_FALSE(consumer->readyToSleep()); // Something is waiting
+    std::vector<std::string> got;
+    auto collect = [&got](const char* data, size_t len) { got.emplace_back(data, len); };
+    EXPECT_EQ(consumer->drain(collect), 1u);
+    EXPECT_TRUE(consumer->readyToSleep());
+    EXPECT_TRUE(producer->push("ROUTE 2", 7));
+    EXPECT_TRUE(producer->takeDoorbell());
+    EXPECT_FALSE(producer->takeDoorbell());
+    consumer->awake();
+    consumer->drain(collect);
+    EXPECT_EQ(got, (std::vector<std::string>{"ROUTE 1", "ROUTE 2"}));
+
+    // A full ring and an oversized message are refused, so the caller falls back to UDP
+    for (int i = 0; i < SHM_RING_CELLS; ++i) ASSERT_TRUE(producer->push("x", 1));
+    EXPECT_FALSE(producer->push("x", 1));
+    EXPECT_FALSE(consumer->empty());
+    EXPECT_EQ(consumer->drain([](const char*, size_t) {}), (size_t)SHM_RING_CELLS);
+    std::string tooLong(SHM_MESSAGE_MAX + 1, 'x');
+    EXPECT_FALSE(producer->push(tooLong.data(), tooLong.size()));
+
+    // A consumer that restarts makes a new ring, which refresh() moves producers to
+    std::unique_ptr<ShmRing> restarted = ShmRing::create(port);
+    ASSERT_NE(restarted, nullptr);
+    ShmRing::refresh(producer, port);
+    ASSERT_NE(producer, nullptr);
+    EXPECT_EQ(producer->instance(), restarted->instance());
+    consumer.reset(); // Leaves the newer ring's name alone
+    EXPECT_NE(ShmRing::attach(port), nullptr);
+
+    // The scheduler commands CAP_SHM cars on this host through their ring;
+    // cars of one host share it, and the rest stay on UDP
+    VirtualClock clock;
+    Scheduler scheduler(0, 10, clock);
+    scheduler.setSharedMemory(true);
+    testing::internal::CaptureStdout();
+    std::string caps = std::to_string(CAP_ROUTE_ACK | CAP_SHM);
+    scheduler.handleMessage(("HELLO 1 0 127.0.0.1 " + std::to_string(port) + " " + caps).c_str());
+    scheduler.handleMessage(("HELLO 2 0 127.0.0.1 " + std::to_string(port) + " " + caps).c_str());
+    scheduler.handleMessage(("HELLO 3 0 127.0.0.1 " + std::to_string(port) + " 1").c_str());
+    scheduler.handleMessage(("HELLO 4 0 127.0.0.1 " + std::to_string(port + 1) + " " + caps).c_str());
+    testing::internal::GetCapturedStdout();
+    EXPECT_TRUE(scheduler.usesSharedMemory(1));
+    EXPECT_TRUE(scheduler.usesSharedMemory(2));
+    EXPECT_FALSE(scheduler.usesSharedMemory(3));
+    EXPECT_FALSE(scheduler.usesSharedMemory(4)); // Nobody made a ring for that port
+}
+
+TEST(SchedulerTest, UringSocketReceivesMoreThanItsBuffersHold) {
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    ASSERT_EQ(bind(sock, (struct sockaddr*)&addr, sizeof(addr)), 0);
+    getsockname(sock, (struct sockaddr*)&addr, &len);
+    int rcvbuf = 1 << 20; // Room for every datagram before the first wait
+    setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    std::unique_ptr<UringSocket> uring = UringSocket::create(sock);
+    if (!uring) {
+        close(sock);
+        GTEST_SKIP() << "io_uring unavailable";
+    }
+
+    // Twice as many datagrams as provided buffers: the receive runs dry and is armed again
+    int peer = socket(AF_INET, SOCK_DGRAM, 0);
+    const int count = 2 * URING_RECV_BUFFERS;
+    for (int i = 0; i < count; ++i) {
+        std::string msg = std::to_string(i);
+        sendto(peer, msg.data(), msg.size(), 0, (struct sockaddr*)&addr, sizeof(addr));
+    }
+    ASSERT_TRUE(uring->send(addr, "self", 4)); // Goes out with the first wait
+    std::vector<std::string> got;
+    for (int tries = 0; tries < 100 && (int)got.size() < count + 1; ++tries) {
+        uring->wait(10, [&got](const char* data, size_t n, const struct sockaddr_in* from) {
+            EXPECT_NE(from, nullptr);
+            EXPECT_EQ(data[n], '\0');
+            got.emplace_back(data, n);
+        });
+    }
+    ASSERT_EQ((int)got.size(), count + 1);
+    for (int i = 0; i < count; ++i) EXPECT_EQ(got[i], std::to_string(i));
+    EXPECT_EQ(got.back(), "self");
+    EXPECT_EQ(uring->sendsCompleted(), 1u);
+    uring.reset();
+    close(peer);
+    close(sock);
+}
+
+TEST(SchedulerTest, ShardsHandEachCarToTheOwnerOfItsBank) {
+    VirtualClock clock;
+    Scheduler first(0, 10, clock), second(0, 10, clock);
+    Scheduler::shard({&first, &second}, 2);
+    EXPECT_TRUE(first.ownsElevator(1));
+    EXPECT_TRUE(first.ownsElevator(2));
+    EXPECT_FALSE(first.ownsElevator(3));
+    EXPECT_TRUE(second.ownsElevator(4));
+    EXPECT_EQ(first.shardOf(5), 0);
+
+    // A car of the other shard's bank is registered there, with the sender's address
+    testing::internal::CaptureStdout();
+    char msg[64];
+    size_t len = putWire(msg, 0, wireHeader(MsgType::HELLO, 3, 1, clock.now(), 2));
+    len = putWire(msg, len, (uint32_t)CAP_ROUTE_ACK);
+    len = putWire(msg, len, (uint32_t)0);
+    len = putWire(msg, len, (uint16_t)6003);
+    struct sockaddr_in from = {};
+    from.sin_family = AF_INET;
+    inet_pton(AF_INET, "10.0.0.7", &from.sin_addr);
+    first.handleDatagram(msg, len, &from);
+    EXPECT_EQ(first.getRegisteredCars(), 0);
+    EXPECT_EQ(first.statsView().forwarded, 1u);
+    second.drainForwarded();
+    EXPECT_EQ(second.getRegisteredCars(), 1);
+    EXPECT_EQ(second.elevatorAddress(3).sin_addr.s_addr, from.sin_addr.s_addr);
+    EXPECT_TRUE(second.usesBinary(3));
+
+    // A hall call goes to a shard with cars; once the first has its own, it keeps them
+    first.handleMessage("2 UP 5");
+    EXPECT_EQ(first.getQueuedRequests(), 0u);
+    second.drainForwarded();
+    EXPECT_EQ(second.getQueuedRequests(), 1u);
+    first.handleMessage("HELLO 1 0 127.0.0.1 6001 0");
+    first.handleMessage("4 DOWN 0");
+    EXPECT_EQ(first.getQueuedRequests(), 1u);
+
+    second.handleMessage("STATUS 1 7");
+    first.drainForwarded();
+    EXPECT_EQ(first.fleet.floorOf(1), 7);
+    StatsView total = first.groupStatsView();
+    EXPECT_EQ(total.registeredCars, 2);
+    EXPECT_EQ(total.forwarded, 3u);
+    EXPECT_EQ(total.rejectedDatagrams, 0u);
+    testing::internal::GetCapturedStdout();
+}
+
+TEST(SchedulerTest, AdmissionControlBoundsTheQueue) {
+    VirtualClock clock;
+    Scheduler scheduler(0, 10, clock); // No cars, so every call waits
+    struct sockaddr_in client = {};
+    client.sin_family = AF_INET;
+    client.sin_port = htons(40000);
+    inet_pton(AF_INET, "127.0.0.1", &client.sin_addr);
+    auto call = [&](const char* text) { scheduler.handleDatagram(text, std::strlen(text), &client); };
+
+    scheduler.setQueueLimit(2, OverloadPolicy::REJECT);
+    for (int i = 0; i < 3; ++i) call("1 UP 5");
+    EXPECT_EQ(scheduler.getQueuedRequests(), 2u);
+    EXPECT_EQ(scheduler.getRefusedRequests(), 1u);
+
+    // Shedding keeps the newest calls
+    scheduler.setQueueLimit(2, OverloadPolicy::SHED_OLDEST);
+    call("2 UP 6");
+    EXPECT_EQ(scheduler.getShedRequests(), 1u);
+    std::vector<Request> queued = scheduler.drainRequests();
+    ASSERT_EQ(queued.size(), 2u);
+    EXPECT_EQ(queued.back().floor, 2);
+    scheduler.restoreRequests(queued);
+
+    // Degrading batches past the limit and refuses only at twice it; greedy
+    // dispatch comes back once the queue has drained
+    scheduler.setQueueLimit(2, OverloadPolicy::DEGRADE);
+    for (int i = 0; i < 3; ++i) call("3 DOWN 0");
+    EXPECT_TRUE(scheduler.isDegraded());
+    EXPECT_EQ(scheduler.getBatchWindow(), std::chrono::milliseconds(OVERLOAD_BATCH_MS));
+    EXPECT_EQ(scheduler.getQueuedRequests(), 4u);
+    EXPECT_EQ(scheduler.getRefusedRequests(), 2u);
+    EXPECT_EQ(scheduler.getQueueHighWater(), 4u);
+    testing::internal::CaptureStdout();
+    for (int id = 1; id <= 4; ++id) {
+        scheduler.handleMessage(("HELLO " + std::to_string(id) + " 0 127.0.0.1 6001 0").c_str());
+    }
+    EXPECT_EQ(scheduler.dispatchPending(), 4);
+    testing::internal::GetCapturedStdout();
+    EXPECT_FALSE(scheduler.isDegraded());
+    EXPECT_EQ(scheduler.getBatchWindow(), Clock::duration::zero());
+
+    // Each sender gets its own bucket, refilled at the rate
+    Scheduler limited(0, 10, clock);
+    limited.setRateLimit(2, 2);
+    for (int i = 0; i < 3; ++i) limited.handleDatagram("1 UP 5", 6, &client);
+    EXPECT_EQ(limited.getRefusedRequests(), 1u);
+    struct sockaddr_in other = client;
+    other.sin_port = htons(40001);
+    limited.handleDatagram("1 UP 5", 6, &other);
+    EXPECT_EQ(limited.getRefusedRequests(), 1u);
+    clock.sleepFor(std::chrono::milliseconds(500));
+    limited.handleDatagram("1 UP 5", 6, &client);
+    EXPECT_EQ(limited.getRefusedRequests(), 1u);
+    EXPECT_EQ(limited.getQueuedRequests(), 4u);
+
+    // The NAK names the call in the format it came in
+    Request req(4, 9, "DOWN");
+    req.seq = 77;
+    Nak nak;
+    std::string text = Scheduler::formatNak(req, NAK_RATE_LIMITED, 250);
+    ASSERT_TRUE(parseNak(text, nak));
+    EXPECT_EQ(nak.reason, NAK_RATE_LIMITED);
+    EXPECT_EQ(nak.retryAfterMs, 250u);
+    EXPECT_TRUE(nak.floor == 4 && nak.down && nak.targetFloor == 9);
+    std::string binary = limited.encodeNak(req, NAK_QUEUE_FULL, 1000);
+    ASSERT_TRUE(decodeNak(binary.data(), binary.size(), nak));
+    EXPECT_EQ(nak.reason, NAK_QUEUE_FULL);
+    EXPECT_EQ(nak.seq, 77u);
+    EXPECT_EQ(nak.retryAfterMs, 1000u);
 }
 
 int main(int argc, char **argv) {
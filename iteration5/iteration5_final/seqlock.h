@@ -0,0 +1,104 @@
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#ifndef CACHE_LINE
+#define CACHE_LINE 64
+#endif
+
+// Holds a small value that one writer publishes and any number of threads read
+// without locking. The sequence number is odd while a store is in progress; a
+// reader that saw it change copies the value again. The value is kept in
+// atomic words so a torn copy is retried rather than undefined behaviour.
+template <typename T>
+class alignas(CACHE_LINE) Seqlock {
+    static_assert(std::is_trivially_copyable<T>::value, "Seqlock copies the value bytewise");
+
+public:
+    Seqlock() { store(T{}); }
+
+    Seqlock(const Seqlock&) = delete;
+    Seqlock& operator=(const Seqlock&) = delete;
+
+    // Writer only; concurrent stores must be serialised by the caller
+    void store(const T& value) {
+        uint64_t buf[WORDS] = {};
+        std::memcpy(buf, &value, sizeof(T));
+        uint32_t s = seq.load(std::memory_order_relaxed);
+        seq.store(s + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t i = 0; i < WORDS; ++i) words[i].store(buf[i], std::memory_order_relaxed);
+        seq.store(s + 2, std::memory_order_release);
+    }
+
+    // Any thread; never waits for the writer to leave a critical section
+    T load() const {
+        uint64_t buf[WORDS];
+        uint32_t before, after;
+        do {
+            before = seq.load(std::memory_order_acquire);
+            for (size_t i = 0; i < WORDS; ++i) buf[i] = words[i].load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            after = seq.load(std::memory_order_relaxed);
+        } while ((before & 1) || before != after);
+        T value;
+        std::memcpy(&value, buf, sizeof(T));
+        return value;
+    }
+
+private:
+    static constexpr size_t WORDS = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+    std::atomic<uint32_t> seq{0};
+    std::atomic<uint64_t> words[WORDS];
+};
+
+// Growable array of Seqlock slots, written by one thread and read by any.
+// Slots are allocated SLOT_CHUNK at a time and a chunk never moves or is freed
+// before the array is, so a reader can index below size() while the writer
+// grows or shrinks it; shrinking only lowers size(). Holds up to MaxSlots.
+template <typename T, size_t MaxSlots>
+class SeqlockSlots {
+public:
+    static constexpr size_t SLOT_CHUNK = 256;
+
+    SeqlockSlots() = default;
+    SeqlockSlots(const SeqlockSlots&) = delete;
+    SeqlockSlots& operator=(const SeqlockSlots&) = delete;
+    ~SeqlockSlots() {
+        for (auto& chunk : chunks) delete[] chunk.load(std::memory_order_relaxed);
+    }
+
+    // Writer only: makes slots below 'n' (at most MaxSlots) writable without
+    // showing them to readers yet
+    void reserve(size_t n) {
+        for (size_t c = 0; c * SLOT_CHUNK < n; ++c) {
+            if (!chunks[c].load(std::memory_order_relaxed)) {
+                chunks[c].store(new Seqlock<T>[SLOT_CHUNK], std::memory_order_release);
+            }
+        }
+    }
+
+    // Writer only
+    void resize(size_t n) {
+        reserve(n);
+        count.store(n, std::memory_order_release);
+    }
+
+    size_t size() const { return count.load(std::memory_order_acquire); }
+
+    Seqlock<T>& operator[](size_t i) { return chunks[i / SLOT_CHUNK].load(std::memory_order_acquire)[i % SLOT_CHUNK]; }
+    const Seqlock<T>& operator[](size_t i) const {
+        return chunks[i / SLOT_CHUNK].load(std::memory_order_acquire)[i % SLOT_CHUNK];
+    }
+
+private:
+    std::atomic<Seqlock<T>*> chunks[(MaxSlots + SLOT_CHUNK - 1) / SLOT_CHUNK] = {};
+    std::atomic<size_t> count{0};
+};
+
+#endif // SEQLOCK_H
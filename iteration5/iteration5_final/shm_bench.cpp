@@ -0,0 +1,166 @@
+// shm_bench.cpp - Latency and throughput of UDP on loopback against the shared-memory ring, between two processes
+#include "shm_ring.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define BENCH_ROUNDS 20000  // Round trips per latency run
+#define BENCH_BURST 200000  // Messages per throughput run
+#define BENCH_WINDOW 128    // Messages in flight before the sender waits for an ACK
+#define BENCH_ACK_EVERY 32  // The receiver acknowledges this many at a time
+#define BENCH_MESSAGE 28    // A binary ROUTE with four stops
+#define BENCH_PORT 59200    // The parent's port; the child has the next one
+#define BENCH_BUFFER 1024
+
+using SteadyClock = std::chrono::steady_clock;
+
+static int bindUdp(int port) {
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (sock < 0 || bind(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        perror("bind");
+        exit(EXIT_FAILURE);
+    }
+    return sock;
+}
+
+// One end of the link: datagrams both ways, or a ring each way with the
+// sockets only carrying doorbells, as the scheduler and elevators use them
+struct Link {
+    int sock;
+    struct sockaddr_in peer;
+    ShmRing* in = nullptr;
+    ShmRing* out = nullptr;
+
+    void send(const char* data, size_t len) {
+        if (!out) {
+            sendto(sock, data, len, 0, (struct sockaddr*)&peer, sizeof(peer));
+            return;
+        }
+        while (!out->send(sock, peer, data, len)) std::this_thread::yield(); // Full: let the reader run
+    }
+
+    // Blocks until at least one message arrives; returns how many were taken
+    size_t receive() {
+        char buffer[BENCH_BUFFER];
+        if (!in) {
+            while (recv(sock, buffer, sizeof(buffer), 0) <= 0) {}
+            return 1;
+        }
+        while (true) {
+            size_t n = in->drain([](const char*, size_t) {});
+            if (n > 0) return n;
+            if (in->readyToSleep()) {
+                struct pollfd fd = {sock, POLLIN, 0};
+                poll(&fd, 1, -1);
+                while (recv(sock, buffer, sizeof(buffer), MSG_DONTWAIT) >= 0) {} // Doorbells carry nothing
+            }
+            in->awake();
+        }
+    }
+};
+
+// Child: echoes every message in the latency run, then acknowledges the burst
+// BENCH_ACK_EVERY messages at a time
+static void echo(Link link) {
+    char msg[BENCH_MESSAGE] = {};
+    for (int i = 0; i < BENCH_ROUNDS; ++i) {
+        link.receive();
+        link.send(msg, sizeof(msg));
+    }
+    size_t received = 0, acked = 0;
+    while (received < BENCH_BURST) {
+        received += link.receive();
+        while (received - acked >= BENCH_ACK_EVERY || (received == BENCH_BURST && acked < received)) {
+            link.send(msg, 4);
+            acked += std::min<size_t>(BENCH_ACK_EVERY, received - acked);
+        }
+    }
+}
+
+struct Result {
+    double p50;  // One-way latency, half the round trip, microseconds
+    double p99;
+    double rate; // Messages per second in the burst
+};
+
+static Result run(bool shm) {
+    int parentSock = bindUdp(BENCH_PORT);
+    int childSock = bindUdp(BENCH_PORT + 1);
+    std::unique_ptr<ShmRing> toParent, toChild;
+    if (shm) {
+        toParent = ShmRing::create(BENCH_PORT); // Mapped before fork(), so both processes share them
+        toChild = ShmRing::create(BENCH_PORT + 1);
+        if (!toParent || !toChild) {
+            perror("shm_open");
+            exit(EXIT_FAILURE);
+        }
+    }
+    auto addr = [](int port) {
+        struct sockaddr_in a = {};
+        a.sin_family = AF_INET;
+        a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        a.sin_port = htons(port);
+        return a;
+    };
+
+    pid_t child = fork();
+    if (child == 0) {
+        echo({childSock, addr(BENCH_PORT), toChild.get(), toParent.get()});
+        _exit(0); // The parent owns the rings
+    }
+    Link link{parentSock, addr(BENCH_PORT + 1), toParent.get(), toChild.get()};
+    char msg[BENCH_MESSAGE] = {};
+
+    std::vector<double> latency;
+    latency.reserve(BENCH_ROUNDS);
+    for (int i = 0; i < BENCH_ROUNDS; ++i) {
+        auto sent = SteadyClock::now();
+        link.send(msg, sizeof(msg));
+        link.receive();
+        latency.push_back(std::chrono::duration<double, std::micro>(SteadyClock::now() - sent).count() / 2);
+    }
+
+    auto start = SteadyClock::now();
+    size_t sent = 0, acked = 0;
+    while (acked < BENCH_BURST) {
+        if (sent < BENCH_BURST && sent - acked < BENCH_WINDOW) {
+            link.send(msg, sizeof(msg));
+            sent++;
+        } else {
+            acked = std::min<size_t>(sent, acked + link.receive() * BENCH_ACK_EVERY);
+        }
+    }
+    double seconds = std::chrono::duration<double>(SteadyClock::now() - start).count();
+
+    waitpid(child, nullptr, 0);
+    close(parentSock);
+    close(childSock);
+    std::sort(latency.begin(), latency.end());
+    return {latency[latency.size() / 2], latency[latency.size() * 99 / 100], BENCH_BURST / seconds};
+}
+
+int main() {
+    std::cout << "Hardware threads: " << std::thread::hardware_concurrency() << "\n\n";
+    std::cout << "| Transport | One-way p50 us | One-way p99 us | Burst msg/s |\n";
+    std::cout << "|-----------|----------------|----------------|-------------|\n";
+    for (bool shm : {false, true}) {
+        Result r = run(shm);
+        std::cout << "| " << std::setw(9) << (shm ? "shm ring" : "UDP") << " | " << std::fixed << std::setprecision(1)
+                  << std::setw(14) << r.p50 << " | " << std::setw(14) << r.p99 << " | " << std::setprecision(0)
+                  << std::setw(11) << r.rate << " |\n";
+    }
+    return 0;
+}
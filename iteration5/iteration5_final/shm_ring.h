@@ -0,0 +1,228 @@
+#ifndef SHM_RING_H
+#define SHM_RING_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "mpsc_ring.h"
+
+#define SHM_RING_CELLS 1024 // Messages a ring holds; a power of two
+#define SHM_MESSAGE_MAX 560 // Longest message a cell holds; a ROUTE with WIRE_MAX_STOPS stops is 534 bytes
+#define SHM_SPIN_US 50      // A consumer polls its ring this long before it sleeps, given a spare CPU
+#define SHM_MAGIC 0x53484d52494e4731ull
+
+// Name of the ring read by whoever takes datagrams on 'port'
+inline std::string shmRingName(int port) {
+    return "/elevator_ring_" + std::to_string(port);
+}
+
+// MpscRing's algorithm over POSIX shared memory, carrying datagrams between
+// processes on one host. Producers claim a cell with a CAS on 'tail', copy the
+// message in and publish it by bumping the cell's sequence; the consumer alone
+// moves 'head'. Nothing in the mapping is a pointer, so each process may map
+// it at a different address.
+//
+// A futex cannot be waited on together with a socket and a timer, and an
+// eventfd cannot be shared between unrelated processes without passing it
+// over a Unix socket, so the consumer keeps listening on its UDP socket:
+// before it sleeps it sets 'asleep', and the first producer to see that sends
+// an empty datagram, a doorbell, to the socket. While the consumer is awake a
+// message costs no syscall at all.
+class ShmRing {
+public:
+    ShmRing(const ShmRing&) = delete;
+    ShmRing& operator=(const ShmRing&) = delete;
+
+    // Consumer: creates the ring for 'port', replacing any left by an earlier process
+    static std::unique_ptr<ShmRing> create(int port) {
+        std::string name = shmRingName(port);
+        shm_unlink(name.c_str());
+        int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd < 0) return nullptr;
+        if (ftruncate(fd, sizeof(Layout)) < 0) {
+            close(fd);
+            shm_unlink(name.c_str());
+            return nullptr;
+        }
+        struct stat st;
+        if (fstat(fd, &st) < 0) st.st_ino = 0;
+        std::unique_ptr<ShmRing> ring(map(fd, name));
+        if (!ring) {
+            shm_unlink(name.c_str());
+            return nullptr;
+        }
+        Layout* l = ring->layout;
+        for (uint64_t i = 0; i < SHM_RING_CELLS; ++i) l->cells[i].seq.store(i, std::memory_order_relaxed);
+        l->instance = (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count() ^ ((uint64_t)getpid() << 40);
+        l->magic.store(SHM_MAGIC, std::memory_order_release); // Producers attach only once this is set
+        ring->owner = true;
+        ring->inode = st.st_ino;
+        return ring;
+    }
+
+    // Producer: maps the ring for 'port'; nullptr if its consumer has not created it
+    static std::unique_ptr<ShmRing> attach(int port) {
+        std::string name = shmRingName(port);
+        int fd = shm_open(name.c_str(), O_RDWR, 0600);
+        if (fd < 0) return nullptr;
+        struct stat st;
+        if (fstat(fd, &st) < 0 || (size_t)st.st_size != sizeof(Layout)) {
+            close(fd);
+            return nullptr;
+        }
+        std::unique_ptr<ShmRing> ring(map(fd, name));
+        if (!ring || ring->layout->magic.load(std::memory_order_acquire) != SHM_MAGIC) return nullptr;
+        return ring;
+    }
+
+    // Producer: keeps 'ring' on the ring 'port' has now. A consumer that
+    // restarted made a new one under the same name, and one that stopped
+    // using rings left none, so 'ring' becomes nullptr.
+    static void refresh(std::unique_ptr<ShmRing>& ring, int port) {
+        std::unique_ptr<ShmRing> current = attach(port);
+        if (!ring || !current || current->instance() != ring->instance()) ring = std::move(current);
+    }
+
+    // The creator unlinks the name, unless a newer ring has taken it over
+    ~ShmRing() {
+        munmap(layout, sizeof(Layout));
+        if (!owner) return;
+        int fd = shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd < 0) return;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_ino == inode) shm_unlink(name.c_str());
+        close(fd);
+    }
+
+    // Any process; false if the ring is full or the message too long for a cell
+    bool push(const char* data, size_t len) {
+        if (len > SHM_MESSAGE_MAX) return false;
+        uint64_t pos = layout->tail.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = layout->cells[pos & MASK];
+            uint64_t seq = cell.seq.load(std::memory_order_acquire);
+            int64_t diff = (int64_t)(seq - pos);
+            if (diff == 0) {
+                if (layout->tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.len = (uint32_t)len;
+                    std::memcpy(cell.data, data, len);
+                    cell.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false; // The consumer has not freed this cell yet
+            } else {
+                pos = layout->tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Producer, after a push(): true if the consumer is asleep and this caller
+    // must ring its doorbell. Only one producer gets true per sleep.
+    bool takeDoorbell() {
+        std::atomic_thread_fence(std::memory_order_seq_cst); // Pairs with readyToSleep()
+        return layout->asleep.load(std::memory_order_relaxed) &&
+               layout->asleep.exchange(0, std::memory_order_relaxed) == 1;
+    }
+
+    // Producer: push(), then an empty datagram from 'sockfd' to the consumer's
+    // socket 'to' if it is asleep; false if the caller must send over UDP instead
+    bool send(int sockfd, const sockaddr_in& to, const char* data, size_t len) {
+        if (!push(data, len)) return false;
+        if (takeDoorbell()) sendto(sockfd, "", 0, 0, (const struct sockaddr*)&to, sizeof(to));
+        return true;
+    }
+
+    // Consumer only: hands every published message to deliver(data, len), in
+    // order, and frees its cell. 'data' points into the ring.
+    template <typename Deliver>
+    size_t drain(Deliver&& deliver) {
+        size_t n = 0;
+        while (true) {
+            Cell& cell = layout->cells[layout->head & MASK];
+            if (cell.seq.load(std::memory_order_acquire) != layout->head + 1) return n;
+            deliver(cell.data, (size_t)cell.len);
+            cell.seq.store(layout->head + SHM_RING_CELLS, std::memory_order_release);
+            layout->head++;
+            n++;
+        }
+    }
+
+    // Consumer only
+    bool empty() const {
+        return layout->cells[layout->head & MASK].seq.load(std::memory_order_acquire) != layout->head + 1;
+    }
+
+    // Consumer, before blocking on its socket: polls for up to SHM_SPIN_US if
+    // there is a CPU for the producers to run on meanwhile, then asks for a
+    // doorbell. False if a message arrived, and the consumer must not block.
+    bool readyToSleep() {
+        static const bool spin = std::thread::hardware_concurrency() > 1;
+        if (spin) {
+            auto until = std::chrono::steady_clock::now() + std::chrono::microseconds(SHM_SPIN_US);
+            do {
+                if (!empty()) return false;
+                cpuRelax();
+            } while (std::chrono::steady_clock::now() < until);
+        }
+        layout->asleep.store(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst); // Pairs with takeDoorbell()
+        if (empty()) return true;
+        layout->asleep.store(0, std::memory_order_relaxed);
+        return false;
+    }
+
+    // Consumer, once its wait returns, doorbell or not
+    void awake() {
+        layout->asleep.store(0, std::memory_order_relaxed);
+    }
+
+    // Differs between rings created under the same name
+    uint64_t instance() const { return layout->instance; }
+
+private:
+    static constexpr uint64_t MASK = SHM_RING_CELLS - 1;
+    static_assert((SHM_RING_CELLS & MASK) == 0, "SHM_RING_CELLS must be a power of two");
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "ring atomics must work across processes");
+
+    struct alignas(CACHE_LINE) Cell {
+        std::atomic<uint64_t> seq;
+        uint32_t len;
+        char data[SHM_MESSAGE_MAX];
+    };
+    struct Layout {
+        std::atomic<uint64_t> magic; // SHM_MAGIC once the creator has set up the cells
+        uint64_t instance;
+        alignas(CACHE_LINE) std::atomic<uint64_t> tail; // Next cell a producer will claim
+        alignas(CACHE_LINE) uint64_t head;              // Next cell the consumer reads
+        alignas(CACHE_LINE) std::atomic<uint32_t> asleep; // The consumer wants a doorbell
+        Cell cells[SHM_RING_CELLS];
+    };
+
+    ShmRing(Layout* layout, const std::string& name) : layout(layout), name(name) {}
+
+    static ShmRing* map(int fd, const std::string& name) {
+        void* mem = mmap(nullptr, sizeof(Layout), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (mem == MAP_FAILED) return nullptr;
+        return new ShmRing(static_cast<Layout*>(mem), name);
+    }
+
+    Layout* layout;
+    std::string name;
+    bool owner = false; // Created the ring, so unlinks it
+    ino_t inode = 0;    // Of the creator's object, to tell it from a newer one
+};
+
+#endif // SHM_RING_H
@@ -0,0 +1,244 @@
+// simulation.cpp - Virtual-time run of the client, scheduler and elevators in one process
+#include "simulation.h"
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <iomanip>
+
+SimScheduler::SimScheduler(Simulation& sim, int elevators, int floors, Clock& clock)
+    : Scheduler(elevators, floors, clock), sim(sim) {}
+
+void SimScheduler::sendRoute(int elevatorID, int seen, const std::vector<int>& stops) {
+    sim.toElevator(elevatorID, formatRoute(elevatorID, seen, stops));
+}
+
+SimElevator::SimElevator(Simulation& sim, int id, Clock& clock) : Elevator(id, clock), sim(sim) {}
+
+// A command reaching a car mid-trip takes effect at once, as in the real loop
+void SimElevator::deliver(const std::string& cmd) {
+    if (busy) {
+        handleCommand(cmd);
+        return;
+    }
+    inbox.push_back(cmd);
+    serveNext();
+}
+
+// Same as Elevator::runEventLoop(): a command either starts a trip or is
+// answered with a STATUS. Messages are never lost here, so there are no heartbeats.
+void SimElevator::serveNext() {
+    while (!inbox.empty()) {
+        std::string cmd = inbox.front();
+        inbox.pop_front();
+        if (handleCommand(cmd) && beginNextStop()) {
+            busy = true;
+            sim.getClock().scheduleAfter(std::chrono::seconds(STEP_DELAY), [this] { stepTrip(); });
+            return;
+        }
+        sendStatus();
+    }
+    busy = false;
+}
+
+// Same as the trip steps of Elevator::runEventLoop()
+void SimElevator::stepTrip() {
+    if (step()) {
+        sim.getClock().scheduleAfter(std::chrono::seconds(STEP_DELAY), [this] { stepTrip(); });
+        return;
+    }
+    if (isStuck()) return; // The real process exits after a hard fault
+    completeStop();
+    if (beginNextStop()) {
+        sim.getClock().scheduleAfter(std::chrono::seconds(STEP_DELAY), [this] { stepTrip(); });
+        return;
+    }
+    sendStatus();
+    busy = false;
+}
+
+// Reports stay in text in the simulator, so traces read like the protocol log
+void SimElevator::sendReport(MsgType type, uint32_t warnings) {
+    sim.toScheduler(formatReport(type, getID(), getCurrentFloor(), warnings));
+}
+
+SimClient::SimClient(Simulation& sim, Clock& clock) : Client(clock), sim(sim) {}
+
+void SimClient::sendRequest(int floor, std::string direction, int targetFloor) {
+    sim.toScheduler(formatRequest(floor, direction, targetFloor));
+}
+
+Simulation::Simulation(int elevators, int floors)
+    : scheduler(*this, elevators, floors, clock), client(*this, clock) {
+    for (int i = 1; i <= elevators; ++i) {
+        this->elevators.push_back(std::make_unique<SimElevator>(*this, i, clock));
+    }
+}
+
+// Schedules every request of the trace at its timestamp
+void Simulation::load(const std::vector<TimedRequest>& requests) {
+    for (const TimedRequest& req : requests) {
+        clock.schedule(Clock::time_point{} + std::chrono::seconds(req.time), [this, req] {
+            client.sendRequest(req.floor, req.direction, req.targetFloor);
+        });
+    }
+}
+
+void Simulation::run(Clock::duration horizon) {
+    clock.run(Clock::time_point{} + horizon);
+}
+
+void Simulation::toScheduler(const std::string& msg) {
+    clock.scheduleAfter(Clock::duration::zero(), [this, msg] {
+        scheduler.handleMessage(msg.c_str());
+        pumpDispatcher();
+    });
+}
+
+void Simulation::toElevator(int id, const std::string& msg) {
+    if (id < 1 || id > (int)elevators.size()) return;
+    clock.scheduleAfter(Clock::duration::zero(), [this, id, msg] { elevators[id - 1]->deliver(msg); });
+}
+
+// Same as runEventLoop(): dispatch only after a wakeup, waiting out the
+// batch window first, and arm a timer for the next warning expiry
+void Simulation::pumpDispatcher() {
+    if (dispatcherAsleep || !scheduler.consumeWakeup()) return;
+    if (scheduler.getBatchWindow() > Clock::duration::zero()) {
+        dispatcherAsleep = true;
+        clock.scheduleAfter(scheduler.getBatchWindow(), [this] {
+            dispatcherAsleep = false;
+            scheduler.dispatchPending();
+            armWarningTimer();
+            pumpDispatcher(); // Wakeups that came in during the window
+        });
+        return;
+    }
+    scheduler.dispatchPending();
+    armWarningTimer();
+}
+
+void Simulation::armWarningTimer() {
+    Clock::time_point expiry = scheduler.nextWarningExpiry();
+    if (expiry == Clock::time_point::max() || expiry == warningTimer) return;
+    warningTimer = expiry;
+    clock.schedule(expiry, [this] {
+        scheduler.expireWarnings();
+        pumpDispatcher();
+        armWarningTimer();
+    });
+}
+
+VirtualClock& Simulation::getClock() {
+    return clock;
+}
+
+Scheduler& Simulation::getScheduler() {
+    return scheduler;
+}
+
+SimClient& Simulation::getClient() {
+    return client;
+}
+
+#ifndef TEST_BUILD
+// Outcome of one run of the trace, for the policy comparison
+struct RunResult {
+    int handled;
+    int moves;
+    size_t unassigned;
+    double averageWait;
+    double simSeconds;
+};
+
+static RunResult runTrace(int elevators, int floors, const std::vector<TimedRequest>& requests,
+                          Clock::duration batchWindow, bool collective, long horizon, bool quiet, bool printTables) {
+    Simulation sim(elevators, floors);
+    sim.getScheduler().setBatchWindow(batchWindow);
+    sim.getScheduler().setCollectiveControl(collective);
+    sim.load(requests);
+
+    std::streambuf* coutBuf = std::cout.rdbuf();
+    std::streambuf* cerrBuf = std::cerr.rdbuf();
+    if (quiet) {
+        std::cout.rdbuf(nullptr);
+        std::cerr.rdbuf(nullptr);
+    }
+    auto wallStart = std::chrono::steady_clock::now();
+    sim.run(std::chrono::seconds(horizon));
+    auto wallTime = std::chrono::steady_clock::now() - wallStart;
+    std::cout.rdbuf(coutBuf);
+    std::cerr.rdbuf(cerrBuf);
+    std::cout.clear();
+    std::cerr.clear();
+
+    Scheduler& scheduler = sim.getScheduler();
+    if (printTables) {
+        scheduler.printStatus();
+        scheduler.printStats();
+        std::cout << "Unassigned Requests: " << scheduler.getQueuedRequests() << "\n";
+        std::cout << "Events Processed: " << sim.getClock().eventsRun() << "\n";
+        std::cout << "Wall Time: " << std::chrono::duration_cast<std::chrono::milliseconds>(wallTime).count() << " ms\n";
+    }
+    return {scheduler.getRequestsHandled(), scheduler.getMoveCount(), scheduler.getQueuedRequests(),
+            scheduler.getAverageWaitSeconds(),
+            std::chrono::duration<double>(sim.getClock().now() - Clock::time_point{}).count()};
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        std::cerr << "Usage: ./simulation <elevators> <floors> [input file] [--quiet] [--horizon <seconds>]"
+                  << " [--batch <ms>] [--collective] [--compare]" << std::endl;
+        return 1;
+    }
+    int elevators = std::atoi(argv[1]);
+    int floors = std::atoi(argv[2]);
+    if (floors < 0 || !isWireFloor(floors)) {
+        std::cerr << "Number of floors must be between 0 and " << INT16_MAX << std::endl;
+        return 1;
+    }
+    std::string inputFile = "input.txt";
+    bool quiet = false;
+    bool compare = false;
+    bool collective = false;
+    long horizon = -1;
+    long batchMs = 0;
+    for (int i = 3; i < argc; ++i) {
+        if (strcmp(argv[i], "--quiet") == 0) quiet = true;
+        else if (strcmp(argv[i], "--compare") == 0) compare = true;
+        else if (strcmp(argv[i], "--collective") == 0) collective = true;
+        else if (strcmp(argv[i], "--horizon") == 0 && i + 1 < argc) horizon = std::atol(argv[++i]);
+        else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) batchMs = std::atol(argv[++i]);
+        else inputFile = argv[i];
+    }
+
+    Client reader(Clock::real());
+    std::vector<TimedRequest> requests = reader.loadRequests(inputFile);
+
+    // By default stop an hour of simulated time after the last request
+    if (horizon < 0) horizon = (requests.empty() ? 0 : requests.back().time) + 3600;
+
+    if (!compare) {
+        runTrace(elevators, floors, requests, std::chrono::milliseconds(batchMs), collective, horizon, quiet, true);
+        return 0;
+    }
+
+    // Same trace under greedy, batch and collective dispatch
+    if (batchMs == 0) batchMs = 1000;
+    RunResult greedy = runTrace(elevators, floors, requests, Clock::duration::zero(), false, horizon, true, false);
+    RunResult batch = runTrace(elevators, floors, requests, std::chrono::milliseconds(batchMs), false, horizon, true, false);
+    RunResult sweep = runTrace(elevators, floors, requests, Clock::duration::zero(), true, horizon, true, false);
+
+    std::cout << "\n| Policy             | Handled | Unassigned | Moves | Avg Wait (s) | Throughput (req/min) |\n";
+    std::cout << "|--------------------|---------|------------|-------|--------------|----------------------|\n";
+    auto row = [](const std::string& name, const RunResult& r) {
+        std::cout << "| " << std::left << std::setw(18) << name << std::right << " | " << std::setw(7) << r.handled
+                  << " | " << std::setw(10) << r.unassigned << " | " << std::setw(5) << r.moves << " | "
+                  << std::fixed << std::setprecision(2) << std::setw(12) << r.averageWait << " | "
+                  << std::setw(20) << (r.simSeconds > 0 ? r.handled * 60.0 / r.simSeconds : 0.0) << " |\n";
+    };
+    row("greedy", greedy);
+    row("batch " + std::to_string(batchMs) + " ms", batch);
+    row("collective", sweep);
+    return 0;
+}
+#endif
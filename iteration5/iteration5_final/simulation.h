@@ -0,0 +1,82 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+#include "clock.h"
+#include "client.h"
+#include "elevator.h"
+#include "scheduler.h"
+
+class Simulation;
+
+// Scheduler whose MOVE commands are delivered through the event queue
+class SimScheduler : public Scheduler {
+public:
+    SimScheduler(Simulation& sim, int elevators, int floors, Clock& clock);
+
+protected:
+    void sendRoute(int elevatorID, int seen, const std::vector<int>& stops) override;
+
+private:
+    Simulation& sim;
+};
+
+// Elevator that serves commands the same way Elevator::start() does, but as events
+class SimElevator : public Elevator {
+public:
+    SimElevator(Simulation& sim, int id, Clock& clock);
+
+    void deliver(const std::string& cmd); // A command datagram reached this car
+    void sendReport(MsgType type, uint32_t warnings) override;
+
+private:
+    void serveNext();  // Takes the next queued command
+    void stepTrip();   // One STEP_DELAY of the trip to the current stop
+
+    Simulation& sim;
+    std::deque<std::string> inbox; // Commands waiting in the socket buffer
+    bool busy = false;             // On a trip
+};
+
+// Client that hands its requests to the event queue instead of the socket
+class SimClient : public Client {
+public:
+    SimClient(Simulation& sim, Clock& clock);
+    void sendRequest(int floor, std::string direction, int targetFloor) override;
+
+private:
+    Simulation& sim;
+};
+
+// Runs client, scheduler and elevators in one thread on a virtual clock.
+// Messages are delivered with zero latency and every sleep becomes an event.
+class Simulation {
+public:
+    Simulation(int elevators, int floors);
+
+    void load(const std::vector<TimedRequest>& requests);
+    void run(Clock::duration horizon); // Stops early once nothing is left to do
+
+    void toScheduler(const std::string& msg);
+    void toElevator(int id, const std::string& msg);
+
+    VirtualClock& getClock();
+    Scheduler& getScheduler();
+    SimClient& getClient();
+
+private:
+    void pumpDispatcher();  // processRequests(), run after every delivered message
+    void armWarningTimer(); // Event at the scheduler's next warning expiry
+
+    VirtualClock clock;
+    SimScheduler scheduler;
+    SimClient client;
+    std::vector<std::unique_ptr<SimElevator>> elevators;
+    bool dispatcherAsleep = false; // Inside a batch window
+    Clock::time_point warningTimer = Clock::time_point::min(); // Expiry already armed
+};
+
+#endif // SIMULATION_H
@@ -0,0 +1,38 @@
+#define TEST_BUILD
+#include <gtest/gtest.h>
+#include <vector>
+#include "simulation.h"
+
+TEST(SimulationTest, VirtualClockRunsEventsInOrder) {
+    VirtualClock clock;
+    std::vector<int> order;
+    clock.scheduleAfter(std::chrono::seconds(5), [&] { order.push_back(3); });
+    clock.scheduleAfter(std::chrono::seconds(1), [&] { order.push_back(1); });
+    clock.scheduleAfter(std::chrono::seconds(1), [&] { order.push_back(2); });
+    clock.run();
+
+    EXPECT_EQ(order, std::vector<int>({1, 2, 3}));
+    EXPECT_EQ(clock.now(), Clock::time_point{} + std::chrono::seconds(5));
+}
+
+TEST(SimulationTest, RunsTraceInVirtualTime) {
+    Simulation sim(2, 10);
+    testing::internal::CaptureStdout();
+    testing::internal::CaptureStderr();
+    sim.load({{1, 1, "UP", 5}, {3, 2, "DOWN", 1}, {3600, 3, "UP", 6}});
+    auto wallStart = std::chrono::steady_clock::now();
+    sim.run(std::chrono::hours(2));
+    auto wallTime = std::chrono::steady_clock::now() - wallStart;
+    testing::internal::GetCapturedStdout();
+    testing::internal::GetCapturedStderr();
+
+    EXPECT_EQ(sim.getScheduler().getRequestsHandled(), 3);
+    EXPECT_EQ(sim.getScheduler().getQueuedRequests(), 0u);
+    EXPECT_GE(sim.getClock().now(), Clock::time_point{} + std::chrono::seconds(3600));
+    EXPECT_LT(wallTime, std::chrono::seconds(1));
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,170 @@
+#ifndef TEXT_PARSER_H
+#define TEXT_PARSER_H
+
+#include <charconv>
+#include <cstring>
+#include <string_view>
+#include <netinet/in.h>
+#include "wire.h"
+
+#define MAX_REPORT_TEXT 64 // Longest valid text message to the scheduler ("WARNING <id> <name>")
+
+// Splits one text datagram into tokens in place. Tokens are views into the
+// datagram and numbers are read with from_chars, so nothing is allocated and
+// nothing throws.
+class TextReader {
+public:
+    explicit TextReader(std::string_view text) : rest(text) {}
+
+    // Next token, empty once the text is used up
+    std::string_view word() {
+        size_t start = 0;
+        while (start < rest.size() && isSeparator(rest[start])) start++;
+        size_t end = start;
+        while (end < rest.size() && !isSeparator(rest[end])) end++;
+        std::string_view token = rest.substr(start, end - start);
+        rest.remove_prefix(end);
+        return token;
+    }
+
+    // Next token as a decimal int; false if it is missing, has anything but
+    // digits after an optional '-', or overflows
+    bool integer(int& value) {
+        return toInt(word(), value);
+    }
+
+    bool atEnd() const {
+        for (char c : rest) {
+            if (!isSeparator(c)) return false;
+        }
+        return true;
+    }
+
+    // Next token as a dotted-quad IPv4 address, stored in network byte order
+    bool ipv4(uint32_t& address) {
+        std::string_view token = word();
+        uint8_t bytes[4];
+        for (int i = 0; i < 4; ++i) {
+            size_t dot = i < 3 ? token.find('.') : token.size();
+            int part;
+            if (dot == std::string_view::npos || !toInt(token.substr(0, dot), part) || part < 0 || part > 255) {
+                return false;
+            }
+            bytes[i] = (uint8_t)part;
+            token.remove_prefix(i < 3 ? dot + 1 : dot);
+        }
+        std::memcpy(&address, bytes, sizeof(address));
+        return true;
+    }
+
+    static bool toInt(std::string_view token, int& value) {
+        if (token.empty()) return false;
+        auto result = std::from_chars(token.data(), token.data() + token.size(), value);
+        return result.ec == std::errc() && result.ptr == token.data() + token.size();
+    }
+
+private:
+    static bool isSeparator(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; }
+
+    std::string_view rest;
+};
+
+// "<ipv4>[:<port>]", as given to --scheduler; without a port, 'defaultPort'
+inline bool parseEndpoint(std::string_view text, int defaultPort, struct sockaddr_in& out) {
+    size_t colon = text.find(':');
+    int port = defaultPort;
+    if (colon != std::string_view::npos &&
+        (!TextReader::toInt(text.substr(colon + 1), port) || port < 1 || port > 65535)) {
+        return false;
+    }
+    TextReader in(text.substr(0, colon));
+    uint32_t address;
+    if (!in.ipv4(address) || !in.atEnd()) return false;
+    out = {};
+    out.sin_family = AF_INET;
+    out.sin_port = htons((uint16_t)port);
+    out.sin_addr.s_addr = address;
+    return true;
+}
+
+// Text form of a scheduler-bound message:
+//   STATUS <id> <floor>, ARRIVED <id> <floor>, POSITION <id> <floor>,
+//   HEARTBEAT <id> <floor>, FAULT <id>, WARNING <id> <name>, BYE <id>,
+//   HELLO <id> <floor> <ipv4> <port> <capabilities>,
+//   or a client request "<floor> <UP|DOWN> <target_floor>".
+// Anything longer than MAX_REPORT_TEXT is rejected before it is scanned, so a
+// bad datagram costs a bounded amount of work. Floors must fit the binary
+// format's int16, so both formats accept the same messages.
+inline bool parseReport(std::string_view text, Report& out) {
+    if (text.empty() || text.size() > MAX_REPORT_TEXT) return false;
+    out = {};
+    TextReader in(text);
+    std::string_view first = in.word();
+    if (first == "STATUS" || first == "ARRIVED" || first == "POSITION" || first == "HEARTBEAT") {
+        out.type = first == "STATUS"    ? MsgType::STATUS
+                   : first == "ARRIVED" ? MsgType::ARRIVED
+                   : first == "POSITION" ? MsgType::POSITION
+                                         : MsgType::HEARTBEAT;
+        return in.integer(out.elevatorID) && in.integer(out.floor) && in.atEnd() && isWireFloor(out.floor);
+    }
+    if (first == "FAULT" || first == "BYE") {
+        out.type = first == "FAULT" ? MsgType::FAULT : MsgType::BYE;
+        return in.integer(out.elevatorID) && in.atEnd();
+    }
+    if (first == "HELLO") {
+        out.type = MsgType::HELLO;
+        int capabilities;
+        if (!in.integer(out.elevatorID) || !in.integer(out.floor) || !in.ipv4(out.address) ||
+            !in.integer(out.port) || !in.integer(capabilities) || !in.atEnd()) {
+            return false;
+        }
+        out.capabilities = (uint32_t)capabilities;
+        return out.port >= 0 && out.port <= 65535 && isWireFloor(out.floor);
+    }
+    if (first == "WARNING") {
+        out.type = MsgType::WARNING;
+        if (!in.integer(out.elevatorID)) return false;
+        std::string_view name = in.word();
+        out.warnings = warningFlagFromName(name);
+        return !name.empty() && in.atEnd();
+    }
+    out.type = MsgType::REQUEST;
+    if (!TextReader::toInt(first, out.floor)) return false;
+    std::string_view direction = in.word();
+    if (direction != "UP" && direction != "DOWN") return false;
+    out.down = direction == "DOWN";
+    return in.integer(out.targetFloor) && in.atEnd() && isWireFloor(out.floor) && isWireFloor(out.targetFloor);
+}
+
+// Text NAK to a client: "NAK <RATE|FULL|SHED> <retry_after_ms> <floor> <UP|DOWN> <target_floor>"
+inline bool parseNak(std::string_view text, Nak& out) {
+    out = {};
+    TextReader in(text);
+    if (in.word() != "NAK") return false;
+    std::string_view reason = in.word();
+    if (reason == "RATE") out.reason = NAK_RATE_LIMITED;
+    else if (reason == "FULL") out.reason = NAK_QUEUE_FULL;
+    else if (reason == "SHED") out.reason = NAK_SHED;
+    else return false;
+    int retry;
+    if (!in.integer(retry) || retry < 0 || !in.integer(out.floor)) return false;
+    out.retryAfterMs = (uint32_t)retry;
+    std::string_view direction = in.word();
+    if (direction != "UP" && direction != "DOWN") return false;
+    out.down = direction == "DOWN";
+    return in.integer(out.targetFloor) && in.atEnd() && isWireFloor(out.floor) && isWireFloor(out.targetFloor);
+}
+
+// Elevator a scheduler command is addressed to: the header's ID for a binary
+// message, whatever its version, or the ID after "ROUTE" or "MOVE" in text.
+// 0 if the command names no elevator.
+inline int commandElevatorID(const char* data, size_t len) {
+    if (isWireMessage(data, len)) return getWire<WireHeader>(data, 0).elevatorID;
+    TextReader in(std::string_view(data, len));
+    std::string_view type = in.word();
+    int id;
+    if ((type != "ROUTE" && type != "MOVE") || !in.integer(id)) return 0;
+    return id;
+}
+
+#endif // TEXT_PARSER_H
@@ -0,0 +1,92 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#define WHEEL_SLOT_BITS 6 // 64 slots per level
+#define WHEEL_LEVELS 4    // 64^4 ticks ahead at most; later timers wait in the last level
+
+// Hierarchical timing wheel. Level 0 has one slot per tick; a slot in level n
+// covers 64^n ticks and is re-filed one level down when level 0 wraps past
+// it. Adding a timer and firing it are O(1), whatever the number pending, and
+// timers are never removed early: the owner checks on expiry whether the timer
+// still means anything.
+template <typename T>
+class TimerWheel {
+public:
+    static constexpr uint64_t SLOTS = 1u << WHEEL_SLOT_BITS;
+    static constexpr uint64_t NONE = UINT64_MAX;
+
+    explicit TimerWheel(uint64_t startTick = 0) : current(startTick) {}
+
+    // A tick that has already passed fires on the next advance()
+    void schedule(uint64_t tick, T value) {
+        if (tick <= current) tick = current + 1;
+        file(tick, std::move(value));
+        count++;
+    }
+
+    // Moves time up to 'tick', calling fire(value) for every timer that is due,
+    // in tick order
+    template <typename Fire>
+    void advance(uint64_t tick, Fire&& fire) {
+        if (count == 0 && tick > current) {
+            current = tick; // Nothing to cascade or fire on the way
+            return;
+        }
+        while (current < tick) {
+            current++;
+            // Re-file the next slot of each higher level whose span starts now
+            for (int level = 1; level < WHEEL_LEVELS; ++level) {
+                if (current & ((1ull << (WHEEL_SLOT_BITS * level)) - 1)) break;
+                cascade(level);
+            }
+            std::vector<Entry> due;
+            due.swap(slots[0][current & (SLOTS - 1)]);
+            count -= due.size();
+            for (Entry& e : due) fire(e.second);
+            if (count == 0 && tick > current) current = tick;
+        }
+    }
+
+    // Earliest tick at which advance() may fire something: the first occupied
+    // level-0 slot, or the next wrap if that comes first, since a higher
+    // level may be re-filed into level 0 then
+    uint64_t nextTick() const {
+        if (count == 0) return NONE;
+        uint64_t wrap = (current | (SLOTS - 1)) + 1;
+        for (uint64_t t = current + 1; t <= current + SLOTS; ++t) {
+            if (!slots[0][t & (SLOTS - 1)].empty()) return t < wrap ? t : wrap;
+        }
+        return wrap;
+    }
+
+    uint64_t now() const { return current; }
+    size_t size() const { return count; }
+
+private:
+    using Entry = std::pair<uint64_t, T>; // Expiry tick and value
+
+    void file(uint64_t tick, T value) {
+        uint64_t delta = tick - current;
+        int level = 0;
+        while (level < WHEEL_LEVELS - 1 && delta >= (1ull << (WHEEL_SLOT_BITS * (level + 1)))) level++;
+        uint64_t slot = (tick >> (WHEEL_SLOT_BITS * level)) & (SLOTS - 1);
+        slots[level][slot].emplace_back(tick, std::move(value));
+    }
+
+    void cascade(int level) {
+        uint64_t slot = (current >> (WHEEL_SLOT_BITS * level)) & (SLOTS - 1);
+        std::vector<Entry> moving;
+        moving.swap(slots[level][slot]);
+        for (Entry& e : moving) file(e.first < current ? current : e.first, std::move(e.second));
+    }
+
+    std::vector<Entry> slots[WHEEL_LEVELS][SLOTS];
+    uint64_t current;
+    size_t count = 0;
+};
+
+#endif // TIMER_WHEEL_H
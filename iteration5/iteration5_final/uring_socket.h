@@ -0,0 +1,347 @@
+#ifndef URING_SOCKET_H
+#define URING_SOCKET_H
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <vector>
+#include <linux/io_uring.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define URING_ENTRIES 512      // Submission queue size; the completion queue is twice that
+#define URING_RECV_BUFFERS 256 // Buffers the kernel fills with datagrams; a power of two
+#define URING_SEND_SLOTS 256   // Datagrams that can be in flight at once
+#define URING_DATAGRAM_MAX 1024 // Longest datagram sent or received, as BUFFER_SIZE
+
+// A UDP socket driven through io_uring, set up with raw system calls. One
+// multishot RECVMSG stays armed on the socket and takes its buffers from a
+// ring of provided buffers, so a stream of datagrams costs no system call per
+// datagram, and sends are queued as SENDMSGs that go to the kernel with the
+// next wait(), in the same io_uring_enter that collects what arrived.
+// Single-threaded: the ring is set up for one issuer.
+class UringSocket {
+public:
+    UringSocket(const UringSocket&) = delete;
+    UringSocket& operator=(const UringSocket&) = delete;
+
+    // nullptr, with errno set, if the kernel has no io_uring or forbids it
+    static std::unique_ptr<UringSocket> create(int sockfd) {
+        std::unique_ptr<UringSocket> ring(new UringSocket(sockfd));
+        if (!ring->setup()) return nullptr;
+        ring->armReceive();
+        return ring;
+    }
+
+    ~UringSocket() {
+        if (sqes) munmap(sqes, URING_ENTRIES * sizeof(io_uring_sqe));
+        if (rings) munmap(rings, ringsSize);
+        if (bufferRing) munmap(bufferRing, URING_RECV_BUFFERS * sizeof(io_uring_buf));
+        if (ringfd >= 0) close(ringfd);
+    }
+
+    // Queues a datagram to 'to'; it leaves with the next wait() or flush().
+    // The data is copied, so the caller's buffer may go at once.
+    bool send(const sockaddr_in& to, const char* data, size_t len) {
+        if (len > URING_DATAGRAM_MAX) return false;
+        if (freeSlots.empty() || sqSpace() == 0) flush();
+        if (freeSlots.empty()) return false; // Every send still in flight
+        uint32_t i = freeSlots.back();
+        freeSlots.pop_back();
+        SendSlot& slot = slots[i];
+        slot.to = to;
+        std::memcpy(slot.data, data, len);
+        slot.iov = {slot.data, len};
+        slot.msg = {};
+        slot.msg.msg_name = &slot.to;
+        slot.msg.msg_namelen = sizeof(slot.to);
+        slot.msg.msg_iov = &slot.iov;
+        slot.msg.msg_iovlen = 1;
+        io_uring_sqe* sqe = nextSqe();
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = sockfd;
+        sqe->addr = (uint64_t)(uintptr_t)&slot.msg;
+        sqe->len = 1;
+        sqe->user_data = SEND_TAG | i;
+        return true;
+    }
+
+    // Submits what is queued and waits up to 'timeoutMs' (-1 forever, 0 not at
+    // all) for something to complete, then hands each datagram received to
+    // deliver(data, len, from). One io_uring_enter unless sends had to be
+    // flushed early.
+    template <typename Deliver>
+    size_t wait(int timeoutMs, Deliver&& deliver) {
+        struct __kernel_timespec ts = {timeoutMs / 1000, (long long)(timeoutMs % 1000) * 1000000};
+        struct io_uring_getevents_arg arg = {};
+        arg.sigmask_sz = _NSIG / 8;
+        if (timeoutMs >= 0) arg.ts = (uint64_t)(uintptr_t)&ts;
+        // Never sleep on completions already reaped
+        enter(timeoutMs == 0 || !received.empty() || watched ? 0 : 1, &arg);
+        reap();
+        if (watchLapsed) {
+            watchLapsed = false;
+            armWatch();
+        }
+        std::vector<io_uring_cqe> batch;
+        batch.swap(received); // deliver() may send, and a send may reap more
+        size_t n = 0;
+        for (const io_uring_cqe& cqe : batch) {
+            if (cqe.res >= 0 && (cqe.flags & IORING_CQE_F_BUFFER)) {
+                uint16_t bid = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+                char* buffer = buffers.data() + (size_t)bid * BUFFER_BYTES;
+                auto* out = reinterpret_cast<io_uring_recvmsg_out*>(buffer);
+                const sockaddr_in* from = out->namelen >= sizeof(sockaddr_in)
+                                              ? reinterpret_cast<const sockaddr_in*>(buffer + sizeof(*out))
+                                              : nullptr;
+                if (!(out->flags & MSG_TRUNC)) {
+                    char* payload = buffer + sizeof(*out) + sizeof(sockaddr_in);
+                    payload[out->payloadlen] = '\0';
+                    deliver(payload, (size_t)out->payloadlen, from);
+                    n++;
+                }
+                recycle(bid);
+            }
+            if (!(cqe.flags & IORING_CQE_F_MORE)) armReceive(); // Out of buffers, or the kernel stopped it
+        }
+        publishBuffers();
+        if (received.empty()) {
+            batch.clear();
+            received.swap(batch); // Keeps the capacity
+        }
+        return n;
+    }
+
+    // Keeps a multishot poll on 'fd', so its becoming readable also ends a
+    // wait(); takeWatched() tells whether it has since the last call
+    void watch(int fd) {
+        watchedFd = fd;
+        armWatch();
+    }
+
+    bool takeWatched() {
+        bool was = watched;
+        watched = false;
+        return was;
+    }
+
+    // Submits the queued sends without waiting
+    void flush() {
+        enter(0, nullptr);
+        reap();
+    }
+
+    uint64_t enterCalls() const { return enters; }
+    uint64_t sendsCompleted() const { return sent; }
+
+private:
+    static constexpr uint64_t RECV_TAG = 0;
+    static constexpr uint64_t SEND_TAG = 1ull << 32;
+    static constexpr uint64_t WATCH_TAG = 2ull << 32;
+    static constexpr uint16_t BUFFER_GROUP = 0;
+    // io_uring_recvmsg_out, the sender's address and the payload with room for a '\0'
+    static constexpr size_t BUFFER_BYTES =
+        (sizeof(io_uring_recvmsg_out) + sizeof(sockaddr_in) + URING_DATAGRAM_MAX + 1 + 63) & ~(size_t)63;
+    static_assert((URING_RECV_BUFFERS & (URING_RECV_BUFFERS - 1)) == 0, "URING_RECV_BUFFERS must be a power of two");
+
+    struct SendSlot {
+        msghdr msg;
+        iovec iov;
+        sockaddr_in to;
+        char data[URING_DATAGRAM_MAX];
+    };
+
+    explicit UringSocket(int sockfd) : sockfd(sockfd) {}
+
+    static int sysSetup(unsigned entries, io_uring_params* p) {
+        return (int)syscall(__NR_io_uring_setup, entries, p);
+    }
+    static int sysRegister(int fd, unsigned op, void* arg, unsigned count) {
+        return (int)syscall(__NR_io_uring_register, fd, op, arg, count);
+    }
+
+    bool setup() {
+        io_uring_params p = {};
+        // Completions are only run when this thread asks for them, which is all it does anyway
+        p.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+        ringfd = sysSetup(URING_ENTRIES, &p);
+        if (ringfd < 0 && errno == EINVAL) {
+            p = {}; // Before 6.1
+            ringfd = sysSetup(URING_ENTRIES, &p);
+        }
+        if (ringfd < 0) return false;
+        if (!(p.features & IORING_FEAT_SINGLE_MMAP) || !(p.features & IORING_FEAT_EXT_ARG)) {
+            errno = ENOSYS; // Older than 5.11
+            return false;
+        }
+
+        ringsSize = std::max(p.sq_off.array + p.sq_entries * sizeof(uint32_t),
+                             p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe));
+        void* mem = mmap(nullptr, ringsSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringfd,
+                         IORING_OFF_SQ_RING);
+        if (mem == MAP_FAILED) return false;
+        rings = static_cast<char*>(mem);
+        mem = mmap(nullptr, URING_ENTRIES * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, ringfd, IORING_OFF_SQES);
+        if (mem == MAP_FAILED) return false;
+        sqes = static_cast<io_uring_sqe*>(mem);
+
+        sqHead = reinterpret_cast<std::atomic<uint32_t>*>(rings + p.sq_off.head);
+        sqTail = reinterpret_cast<std::atomic<uint32_t>*>(rings + p.sq_off.tail);
+        sqMask = *reinterpret_cast<uint32_t*>(rings + p.sq_off.ring_mask);
+        sqEntries = p.sq_entries;
+        uint32_t* array = reinterpret_cast<uint32_t*>(rings + p.sq_off.array);
+        for (uint32_t i = 0; i < p.sq_entries; ++i) array[i] = i; // SQE i always sits at slot i
+        cqHead = reinterpret_cast<std::atomic<uint32_t>*>(rings + p.cq_off.head);
+        cqTail = reinterpret_cast<std::atomic<uint32_t>*>(rings + p.cq_off.tail);
+        cqMask = *reinterpret_cast<uint32_t*>(rings + p.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(rings + p.cq_off.cqes);
+        sqLocalTail = sqTail->load(std::memory_order_relaxed);
+
+        // The provided buffers, registered as a ring the kernel takes them from
+        mem = mmap(nullptr, URING_RECV_BUFFERS * sizeof(io_uring_buf), PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED) return false;
+        bufferRing = static_cast<io_uring_buf*>(mem);
+        io_uring_buf_reg reg = {};
+        reg.ring_addr = (uint64_t)(uintptr_t)bufferRing;
+        reg.ring_entries = URING_RECV_BUFFERS;
+        reg.bgid = BUFFER_GROUP;
+        if (sysRegister(ringfd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) return false; // Before 5.19
+        buffers.resize((size_t)URING_RECV_BUFFERS * BUFFER_BYTES);
+        for (uint16_t bid = 0; bid < URING_RECV_BUFFERS; ++bid) recycle(bid);
+        publishBuffers();
+
+        slots.reset(new SendSlot[URING_SEND_SLOTS]);
+        for (uint32_t i = URING_SEND_SLOTS; i > 0; --i) freeSlots.push_back(i - 1);
+        received.reserve(p.cq_entries);
+        return true;
+    }
+
+    // One RECVMSG that keeps completing, once per datagram, until it runs out of buffers
+    void armReceive() {
+        receiveHeader = {};
+        receiveHeader.msg_namelen = sizeof(sockaddr_in);
+        if (sqSpace() == 0) flush();
+        io_uring_sqe* sqe = nextSqe();
+        sqe->opcode = IORING_OP_RECVMSG;
+        sqe->fd = sockfd;
+        sqe->addr = (uint64_t)(uintptr_t)&receiveHeader;
+        sqe->len = 1;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = BUFFER_GROUP;
+        sqe->user_data = RECV_TAG;
+    }
+
+    void armWatch() {
+        if (sqSpace() == 0) flush();
+        io_uring_sqe* sqe = nextSqe();
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = watchedFd;
+        sqe->poll32_events = POLLIN;
+        sqe->len = IORING_POLL_ADD_MULTI;
+        sqe->user_data = WATCH_TAG;
+    }
+
+    uint32_t sqSpace() const {
+        return sqEntries - (sqLocalTail - sqHead->load(std::memory_order_acquire));
+    }
+
+    io_uring_sqe* nextSqe() {
+        io_uring_sqe* sqe = &sqes[sqLocalTail & sqMask];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqLocalTail++;
+        return sqe;
+    }
+
+    void enter(unsigned minComplete, io_uring_getevents_arg* arg) {
+        uint32_t toSubmit = sqLocalTail - sqTail->load(std::memory_order_relaxed);
+        sqTail->store(sqLocalTail, std::memory_order_release);
+        unsigned flags = IORING_ENTER_GETEVENTS;
+        size_t argSize = 0;
+        if (arg) {
+            flags |= IORING_ENTER_EXT_ARG;
+            argSize = sizeof(*arg);
+        }
+        enters++;
+        // -ETIME on a timeout and -EINTR on a signal are normal returns here
+        syscall(__NR_io_uring_enter, ringfd, toSubmit, minComplete, flags, arg, argSize);
+    }
+
+    // Retires finished sends and notes the watched fd; datagrams are kept for
+    // wait() to deliver
+    void reap() {
+        uint32_t head = cqHead->load(std::memory_order_relaxed);
+        uint32_t tail = cqTail->load(std::memory_order_acquire);
+        for (; head != tail; ++head) {
+            const io_uring_cqe& cqe = cqes[head & cqMask];
+            if (cqe.user_data == WATCH_TAG) {
+                watched = true;
+                if (!(cqe.flags & IORING_CQE_F_MORE)) watchLapsed = true; // Armed again by the next wait()
+            } else if (cqe.user_data & SEND_TAG) {
+                freeSlots.push_back((uint32_t)(cqe.user_data & ~SEND_TAG));
+                if (cqe.res >= 0) sent++; // A failed send is dropped, as a failed sendto would be
+            } else {
+                received.push_back(cqe);
+            }
+        }
+        cqHead->store(head, std::memory_order_release);
+    }
+
+    // Gives a buffer back to the kernel; it sees it after publishBuffers()
+    void recycle(uint16_t bid) {
+        io_uring_buf& buf = bufferRing[bufferTail & (URING_RECV_BUFFERS - 1)];
+        buf.addr = (uint64_t)(uintptr_t)(buffers.data() + (size_t)bid * BUFFER_BYTES);
+        buf.len = BUFFER_BYTES - 1; // Room for the '\0' after the payload
+        buf.bid = bid;
+        bufferTail++;
+    }
+
+    void publishBuffers() {
+        reinterpret_cast<std::atomic<uint16_t>*>(&bufferRing[0].resv)->store(bufferTail, std::memory_order_release);
+    }
+
+    int sockfd;
+    int ringfd = -1;
+    char* rings = nullptr;
+    size_t ringsSize = 0;
+    io_uring_sqe* sqes = nullptr;
+    std::atomic<uint32_t>* sqHead = nullptr;
+    std::atomic<uint32_t>* sqTail = nullptr;
+    uint32_t sqMask = 0;
+    uint32_t sqEntries = 0;
+    uint32_t sqLocalTail = 0; // SQEs written, some not yet handed to the kernel
+    std::atomic<uint32_t>* cqHead = nullptr;
+    std::atomic<uint32_t>* cqTail = nullptr;
+    uint32_t cqMask = 0;
+    io_uring_cqe* cqes = nullptr;
+
+    // The kernel's io_uring_buf_ring, whose tail overlays bufs[0].resv. Its
+    // flexible array is laid out differently in C++, so it is not used.
+    io_uring_buf* bufferRing = nullptr;
+    uint16_t bufferTail = 0;
+    std::vector<char> buffers;           // URING_RECV_BUFFERS of BUFFER_BYTES each
+    msghdr receiveHeader = {};           // Read by the kernel for as long as the receive is armed
+    std::vector<io_uring_cqe> received;  // Datagram completions reaped but not yet delivered
+
+    int watchedFd = -1;
+    bool watched = false;     // The watched fd became readable
+    bool watchLapsed = false; // Its poll ended and needs arming again
+
+    std::unique_ptr<SendSlot[]> slots;
+    std::vector<uint32_t> freeSlots;
+    uint64_t enters = 0;
+    uint64_t sent = 0;
+};
+
+#endif // URING_SOCKET_H
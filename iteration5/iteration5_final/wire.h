@@ -0,0 +1,232 @@
+#ifndef WIRE_H
+#define WIRE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <type_traits>
+#include "clock.h"
+
+// Binary message format shared by the scheduler, the elevators and the client.
+// Every message starts with a fixed 16-byte header; a few types carry a small
+// body after it. Peers may run on different machines, so every multi-byte
+// field is little-endian on the wire whatever the host's byte order; putWire()
+// and getWire() do the conversion, which is a plain copy on x86 and ARM.
+// The text format ("STATUS 2 5", "ROUTE 3 0 7 9", "5 UP 9") is still accepted
+// everywhere for debugging; a text message never starts with WIRE_MAGIC.
+#define WIRE_MAGIC 0xE7
+#define WIRE_VERSION 2 // 2: ROUTE carries the scheduler's epoch
+#define WIRE_MAX_STOPS 255 // A ROUTE's stop count fits in the header's 'aux' byte
+#define WIRE_REPLAY_WINDOW 1024 // A ROUTE at most this far behind the last one is a duplicate or reordered
+
+// POSITION, HEARTBEAT, ACK, HELLO, BYE and NAK came after the first release;
+// peers that predate them reject them as malformed
+enum class MsgType : uint8_t {
+    STATUS = 1, ARRIVED, FAULT, WARNING, REQUEST, ROUTE, POSITION, HEARTBEAT, ACK, HELLO, BYE, NAK
+};
+
+// What a car announces it can do in its HELLO
+enum Capability : uint32_t {
+    CAP_NONE = 0,
+    CAP_ROUTE_ACK = 1u << 0, // Acknowledges binary routes, so they can be resent until it does
+    CAP_SHM = 1u << 1,       // Also takes commands from the shared-memory ring named after its port
+};
+
+// Bits set by WARNING messages; more than one can be active at a time
+enum WarningFlag : uint32_t {
+    WARN_NONE = 0,
+    WARN_DOOR_STUCK = 1u << 0,
+    WARN_UNKNOWN = 1u << 31, // Warning name the scheduler does not recognise
+};
+
+// Why the scheduler turned a hall call away, in a NAK's 'aux'
+enum NakReason : uint8_t {
+    NAK_RATE_LIMITED = 1, // The sender is over its rate
+    NAK_QUEUE_FULL = 2,   // Too many calls are waiting already
+    NAK_SHED = 3,         // Queued, then dropped to make room for a newer call
+};
+
+inline const char* nakReasonName(NakReason reason) {
+    return reason == NAK_RATE_LIMITED ? "RATE" : reason == NAK_QUEUE_FULL ? "FULL" : "SHED";
+}
+
+// Maps a WARNING message's name to its flag
+inline uint32_t warningFlagFromName(std::string_view name) {
+    if (name == "DOOR_STUCK") return WARN_DOOR_STUCK;
+    return WARN_UNKNOWN;
+}
+
+// Name used for a flag in the text format
+inline const char* warningName(uint32_t flag) {
+    return flag == WARN_DOOR_STUCK ? "DOOR_STUCK" : "UNKNOWN";
+}
+
+struct WireHeader {
+    uint8_t magic;        // WIRE_MAGIC
+    uint8_t version;      // WIRE_VERSION of the sender
+    MsgType type;
+    uint8_t aux;          // ROUTE: number of stops; REQUEST: 1 if going DOWN; NAK: NakReason
+    uint16_t elevatorID;  // 0 for client requests
+    int16_t floor;        // Reports from a car: its floor; REQUEST: pickup floor
+    uint32_t seq;         // Per-sender sequence number
+    uint32_t timestampUs; // Sender's clock in microseconds, wrapping; for latency measurement
+};
+static_assert(sizeof(WireHeader) == 16, "header layout is part of the protocol");
+
+// Bodies after the header:
+//   WARNING  uint32 WarningFlag bits
+//   REQUEST  int16 target floor
+//   ROUTE    uint32 <seen>, uint32 epoch of the sending scheduler, then 'aux'
+//            int16 stops
+//   ACK      uint32 seq of the ROUTE being acknowledged
+//   HELLO    uint32 Capability bits, uint32 IPv4 address in network order (0
+//            for the sender's), uint16 port the car takes commands on
+//   NAK      uint32 milliseconds before the call may be sent again; the header
+//            has the call's seq and pickup floor, and its NakReason in 'aux'
+inline size_t wireSize(MsgType type, int stops = 0) {
+    switch (type) {
+    case MsgType::HELLO: return sizeof(WireHeader) + 2 * sizeof(uint32_t) + sizeof(uint16_t);
+    case MsgType::WARNING:
+    case MsgType::ACK:
+    case MsgType::NAK: return sizeof(WireHeader) + sizeof(uint32_t);
+    case MsgType::REQUEST: return sizeof(WireHeader) + sizeof(int16_t);
+    case MsgType::ROUTE: return sizeof(WireHeader) + 2 * sizeof(uint32_t) + stops * sizeof(int16_t);
+    default: return sizeof(WireHeader);
+    }
+}
+
+// Floors travel as int16, so anything outside that range is refused where it
+// enters (text parsing, the client's trace, the scheduler's command line)
+// rather than truncated when it is encoded
+inline bool isWireFloor(int floor) {
+    return floor >= INT16_MIN && floor <= INT16_MAX;
+}
+
+inline bool isWireMessage(const char* data, size_t len) {
+    return len >= sizeof(WireHeader) && static_cast<uint8_t>(data[0]) == WIRE_MAGIC;
+}
+
+inline WireHeader wireHeader(MsgType type, int elevatorID, uint32_t seq, Clock::time_point now,
+                             int floor = 0, uint8_t aux = 0) {
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch()).count();
+    return {WIRE_MAGIC, WIRE_VERSION, type, aux, static_cast<uint16_t>(elevatorID),
+            static_cast<int16_t>(floor), seq, static_cast<uint32_t>(us)};
+}
+
+// Unsigned integer a wire field is shifted through
+template <typename T, bool = std::is_enum_v<T>>
+struct WireBits { using type = std::make_unsigned_t<T>; };
+template <typename T>
+struct WireBits<T, true> { using type = std::make_unsigned_t<std::underlying_type_t<T>>; };
+
+// Fields are written byte by byte, least significant first, since bodies are
+// not aligned and the wire is little-endian
+template <typename T>
+inline size_t putWire(char* out, size_t at, T value) {
+    static_assert(std::is_integral_v<T> || std::is_enum_v<T>, "wire fields are integers");
+    using Bits = typename WireBits<T>::type;
+    Bits bits = static_cast<Bits>(value);
+    for (size_t i = 0; i < sizeof(T); ++i) out[at + i] = static_cast<char>(static_cast<uint8_t>(bits >> (8 * i)));
+    return at + sizeof(T);
+}
+
+template <typename T>
+inline T getWire(const char* data, size_t at) {
+    static_assert(std::is_integral_v<T> || std::is_enum_v<T>, "wire fields are integers");
+    using Bits = typename WireBits<T>::type;
+    Bits bits = 0;
+    for (size_t i = 0; i < sizeof(T); ++i) bits |= static_cast<Bits>(static_cast<uint8_t>(data[at + i])) << (8 * i);
+    return static_cast<T>(bits);
+}
+
+// The header field by field, in its in-memory layout
+inline size_t putWire(char* out, size_t at, const WireHeader& header) {
+    at = putWire(out, at, header.magic);
+    at = putWire(out, at, header.version);
+    at = putWire(out, at, header.type);
+    at = putWire(out, at, header.aux);
+    at = putWire(out, at, header.elevatorID);
+    at = putWire(out, at, header.floor);
+    at = putWire(out, at, header.seq);
+    return putWire(out, at, header.timestampUs);
+}
+
+template <>
+inline WireHeader getWire<WireHeader>(const char* data, size_t at) {
+    return {getWire<uint8_t>(data, at + offsetof(WireHeader, magic)),
+            getWire<uint8_t>(data, at + offsetof(WireHeader, version)),
+            getWire<MsgType>(data, at + offsetof(WireHeader, type)),
+            getWire<uint8_t>(data, at + offsetof(WireHeader, aux)),
+            getWire<uint16_t>(data, at + offsetof(WireHeader, elevatorID)),
+            getWire<int16_t>(data, at + offsetof(WireHeader, floor)),
+            getWire<uint32_t>(data, at + offsetof(WireHeader, seq)),
+            getWire<uint32_t>(data, at + offsetof(WireHeader, timestampUs))};
+}
+
+// False unless the message is binary, from this version and complete
+inline bool readWireHeader(const char* data, size_t len, WireHeader& header) {
+    if (!isWireMessage(data, len)) return false;
+    header = getWire<WireHeader>(data, 0);
+    return header.version == WIRE_VERSION && len >= wireSize(header.type, header.aux);
+}
+
+// A message to the scheduler from a car or a client, in either format
+struct Report {
+    MsgType type;
+    int elevatorID;    // 0 for client requests
+    int floor;         // Car's floor, or a request's pickup floor
+    int targetFloor;   // REQUEST only
+    bool down;         // REQUEST only
+    uint32_t warnings; // WARNING only
+    uint32_t ackedSeq; // ACK only
+    uint32_t capabilities; // HELLO only: Capability bits
+    uint32_t address;      // HELLO only: IPv4 in network order, 0 for the sender's
+    int port;              // HELLO only
+};
+
+// Binary counterpart of parseReport() in text_parser.h
+inline bool decodeReport(const char* data, size_t len, Report& out) {
+    WireHeader header;
+    if (!readWireHeader(data, len, header)) return false;
+    out = {header.type, header.elevatorID, header.floor, 0, header.aux != 0, WARN_NONE, 0, CAP_NONE, 0, 0};
+    switch (header.type) {
+    case MsgType::STATUS:
+    case MsgType::ARRIVED:
+    case MsgType::POSITION:
+    case MsgType::HEARTBEAT:
+    case MsgType::BYE:
+    case MsgType::FAULT: return true;
+    case MsgType::WARNING: out.warnings = getWire<uint32_t>(data, sizeof(WireHeader)); return true;
+    case MsgType::REQUEST: out.targetFloor = getWire<int16_t>(data, sizeof(WireHeader)); return true;
+    case MsgType::ACK: out.ackedSeq = getWire<uint32_t>(data, sizeof(WireHeader)); return true;
+    case MsgType::HELLO:
+        out.capabilities = getWire<uint32_t>(data, sizeof(WireHeader));
+        // Already in network order, the one byte sequence not converted
+        std::memcpy(&out.address, data + sizeof(WireHeader) + sizeof(uint32_t), sizeof(out.address));
+        out.port = getWire<uint16_t>(data, sizeof(WireHeader) + 2 * sizeof(uint32_t));
+        return true;
+    default: return false; // ROUTE or an unknown tag
+    }
+}
+
+// A hall call the scheduler turned away, as the client sees it. Binary NAKs
+// name the call by its seq, text ones repeat the call.
+struct Nak {
+    NakReason reason;
+    uint32_t retryAfterMs;
+    uint32_t seq;    // Binary only
+    int floor;
+    bool down;       // Text only
+    int targetFloor; // Text only
+};
+
+inline bool decodeNak(const char* data, size_t len, Nak& out) {
+    WireHeader header;
+    if (!readWireHeader(data, len, header) || header.type != MsgType::NAK) return false;
+    out = {static_cast<NakReason>(header.aux), getWire<uint32_t>(data, sizeof(WireHeader)), header.seq,
+           header.floor, false, 0};
+    return true;
+}
+
+#endif // WIRE_H